@@ -0,0 +1,263 @@
+/**
+ * @file bench.c
+ * @author Wilfred Mallawa
+ * @brief Micro benchmarks of the per-sample kernels and the screen
+ *        render path, run once at boot before the app threads start, so
+ *        nothing else touches the framebuffer. Costs are measured with the
+ *        timing functions and printed one CSV row per benchmark:
+ *
+ *          bench,<name>,<iterations>,<cycles per iteration>,<ns per iteration>
+ *
+ *        The fixed-point tilt is checked against libm over the range of
+ *        the accelerometer, as
+ *
+ *          accuracy,<name>,<points>,<max error centi-degrees>
+ *
+ *        The live pipeline (sample cycle start to frame sent, button to
+ *        frame, fetch phase) is printed by the 'bench' shell command as
+ *
+ *          pipe,<name>,<count>,<last us>,<max us>
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/display.h>
+#include <zephyr/timing/timing.h>
+#include <zephyr/logging/log.h>
+#ifdef CONFIG_SHELL
+#include <zephyr/shell/shell.h>
+#endif
+
+#include "bench.h"
+#include <sens.h>
+#include <sens_fuel.h>
+#include <sens_orient.h>
+#include <battery.h>
+#include <display_ctl.h>
+#include <disp_fb.h>
+#include <disp_layout.h>
+
+LOG_MODULE_REGISTER(bench, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define ITERS       CONFIG_APP_BENCH_ITERS
+#define SEND_ITERS  MAX(ITERS / 100, 10)    //display writes go over I2C
+
+enum bench_id {
+	B_BATT_LEVEL,
+	B_FUEL_PPTT,
+	B_VALUE_TO_FIXED,
+	B_TILT,
+	B_TILT_LIBM,
+	B_ATAN2,
+	B_ORIENT,
+	B_LAYOUT_FULL,
+	B_LAYOUT_DELTA,
+	B_RENDER_DELTA,
+	B_FB_FULL,
+	B_COUNT,
+};
+
+/* The devicetree discharge curve sens_fuel uses, as battery_level_pptt() takes it */
+#define CURVE_POINT(node, prop, idx) \
+	{ DT_PROP_BY_IDX(node, curve_pptt, idx), DT_PROP_BY_IDX(node, prop, idx) },
+
+static const struct battery_level_point curve[] = {
+#if DT_HAS_CHOSEN(app_battery_curve)
+	DT_FOREACH_PROP_ELEM(DT_CHOSEN(app_battery_curve), curve_mv, CURVE_POINT)
+#else
+	/* sens_fuel's linear fallback */
+	{ 10000, 3600 },
+	{ 0, 1700 },
+#endif
+};
+
+static struct bench_result results[B_COUNT];
+static volatile int32_t sink;
+static uint32_t tilt_points, tilt_err;     //accuracy sweep, centi-degrees
+
+static void record(enum bench_id id, const char *name, uint32_t iters,
+		   timing_t t0, timing_t t1)
+{
+	uint64_t cyc = timing_cycles_get(&t0, &t1);
+
+	results[id] = (struct bench_result){
+		.name = name,
+		.iters = iters,
+		.cycles = cyc / iters,
+		.ns = timing_cycles_to_ns(cyc) / iters,
+	};
+}
+
+/* Time _iters runs of _body, i is the iteration number */
+#define BENCH(_id, _name, _iters, _body) do { \
+	timing_t t0 = timing_counter_get(); \
+	for (uint32_t i = 0; i < (_iters); i++) { \
+		_body; \
+	} \
+	record(_id, _name, _iters, t0, timing_counter_get()); \
+} while (0)
+
+/* The double precision tilt sens_tilt_xy replaced, as reference */
+static int16_t tilt_xy_libm(int32_t x, int32_t y)
+{
+	if (y == 0) {
+		return (x == 0) ? 0 : (x < 0) ? -9000 : 9000;
+	}
+	return atan((double)x / y) * RAD_TO_DEG * 100;
+}
+
+/* Worst case error of sens_tilt_xy over +-2 g on both axes, in centi-degrees */
+static void bench_tilt_accuracy(void)
+{
+	for (int32_t y = -200; y <= 200; y += 5) {
+		for (int32_t x = -200; x <= 200; x += 5) {
+			double ref = atan2(x, y) * RAD_TO_DEG * 100;
+			uint32_t err;
+
+			/* atan(x / y) is atan2 folded onto y >= 0 */
+			if (y < 0) {
+				ref += (ref > 0) ? -18000 : 18000;
+			} else if (y == 0) {
+				ref = (x == 0) ? 0 : (x < 0) ? -9000 : 9000;
+			}
+			err = abs(sens_tilt_xy(x, y) - (int32_t)lround(ref));
+			tilt_err = MAX(tilt_err, err);
+			tilt_points++;
+		}
+	}
+}
+
+static void bench_kernels(void)
+{
+	struct sensor_value v[3] = {
+		{ 21, 537000 },     //C
+		{ 45, 120000 },     //%RH
+		{ 101, 325000 },    //kPa
+	};
+	struct sens_packet pkt;
+
+	BENCH(B_BATT_LEVEL, "battery_level_pptt", ITERS,
+	      sink += battery_level_pptt(3000 + i % 1000, curve));
+	BENCH(B_FUEL_PPTT, "sens_fuel_pptt", ITERS,
+	      sink += sens_fuel_pptt(3000 + i % 1000));
+	BENCH(B_VALUE_TO_FIXED, "value_to_packet", ITERS,
+	      v[0].val2 = i;
+	      pkt.hts221_temp = sens_value_to_fixed(&v[0], 100);
+	      pkt.hts221_rh = sens_value_to_fixed(&v[1], 100);
+	      pkt.lps22hb_temp = sens_value_to_fixed(&v[0], 100);
+	      pkt.lps22hb_press = sens_value_to_fixed(&v[2], 1000);
+	      sink += pkt.hts221_temp + pkt.lps22hb_press);
+	BENCH(B_TILT, "tilt_xy", ITERS,
+	      sink += sens_tilt_xy((int32_t)(i % 200) - 100, 98 - (int32_t)(i % 37)));
+	BENCH(B_TILT_LIBM, "tilt_xy_libm", ITERS,
+	      sink += tilt_xy_libm((int32_t)(i % 200) - 100, 98 - (int32_t)(i % 37)));
+	BENCH(B_ATAN2, "atan2_cordic", ITERS,
+	      sink += sens_atan2((int32_t)(i % 200) - 100, (int32_t)(i % 37) - 18));
+	/* Filter plus pitch, roll, tilt and xy, one accelerometer sample */
+	BENCH(B_ORIENT, "orient_update", ITERS,
+	      sens_orient_update((int32_t)(i % 20) - 10, 5, 98));
+	sens_orient_reset();
+	bench_tilt_accuracy();
+}
+
+static void bench_render(void)
+{
+	const struct device *dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
+	/* The first screen built in, the climate one by default */
+	const struct disp_screen *scr = disp_screen_get(0);
+	struct sens_packet pkt = {
+		.hts221_temp = 2153,
+		.hts221_rh = 4512,
+		.lps22hb_temp = 2161,
+		.lps22hb_press = 101325,
+		.version = SENS_PACKET_VERSION,
+	};
+
+	if (!device_is_ready(dev) ||
+	    display_set_pixel_format(dev, PIXEL_FORMAT_MONO10) != 0 ||
+	    disp_fb_init(dev) != 0) {
+		LOG_WRN("display not available, render benchmarks skipped");
+		return;
+	}
+
+	/* Labels and every field, as on a screen switch */
+	BENCH(B_LAYOUT_FULL, "layout_draw_full", ITERS,
+	      disp_layout_invalidate();
+	      sink += disp_layout_draw(scr, &pkt));
+	/* One field changes per frame, the steady state */
+	BENCH(B_LAYOUT_DELTA, "layout_draw_delta", ITERS,
+	      pkt.hts221_temp += 10;
+	      sink += disp_layout_draw(scr, &pkt));
+	/* Steady state frame including the changed spans sent to the panel */
+	BENCH(B_RENDER_DELTA, "render_delta_send", SEND_ITERS,
+	      pkt.hts221_temp += 10;
+	      sink += disp_layout_render(dev, scr, &pkt));
+	BENCH(B_FB_FULL, "fb_full_send", SEND_ITERS,
+	      disp_fb_invalidate();
+	      sink += disp_fb_finalize(dev));
+
+	/* Leave a clean slate for the display thread */
+	disp_fb_clear();
+	disp_fb_invalidate();
+	disp_layout_invalidate();
+}
+
+void bench_print(void)
+{
+	printk("bench,name,iters,cycles,ns\n");
+	for (int i = 0; i < B_COUNT; i++) {
+		if (results[i].name) {
+			printk("bench,%s,%u,%u,%u\n", results[i].name,
+			       results[i].iters, results[i].cycles, results[i].ns);
+		}
+	}
+	if (tilt_points) {
+		printk("accuracy,tilt_xy,%u,%u\n", tilt_points, tilt_err);
+	}
+}
+
+void bench_run(void)
+{
+	timing_init();
+	timing_start();
+	bench_kernels();
+	bench_render();
+	timing_stop();
+	bench_print();
+}
+
+#ifdef CONFIG_SHELL
+static void pipe_print(const struct shell *sh, const char *name,
+		       const struct disp_latency *lat)
+{
+	shell_print(sh, "pipe,%s,%u,%u,%u", name, lat->count, lat->last_us,
+		    lat->max_us);
+}
+
+/* Boot results again, plus the live pipeline numbers */
+static int cmd_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_acq_stats acq;
+	struct disp_latency lat;
+
+	bench_print();
+
+	shell_print(sh, "pipe,name,count,last_us,max_us");
+	disp_e2e_latency_get(&lat);
+	pipe_print(sh, "cycle_to_frame", &lat);
+	disp_btn_latency_get(&lat);
+	pipe_print(sh, "button_to_frame", &lat);
+	sens_acq_stats_get(&acq);
+	lat = (struct disp_latency){ acq.last_us, acq.max_us, acq.cycles };
+	pipe_print(sh, "fetch", &lat);
+	return 0;
+}
+
+SHELL_CMD_REGISTER(bench, NULL, "Benchmark results, CSV", cmd_bench);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,27 @@
+/**
+ * @file bench.h
+ * @author Wilfred Mallawa
+ * @brief On-target micro benchmarks of the sample and render kernels.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/* One benchmark result, per iteration costs */
+struct bench_result {
+    const char *name;
+    uint32_t iters;
+    uint32_t cycles;
+    uint32_t ns;
+};
+
+/* Function Declarations */
+extern void bench_run(void);
+extern void bench_print(void);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * @file disp_fb.c
+ * @author Wilfred Mallawa
+ * @brief Page framebuffer for the SSD1306/SH1106. Text is drawn with the
+ *        character framebuffer fonts, exactly as cfb_print lays it out,
+ *        but finalize compares every page with what was last sent and
+ *        only writes the changed column span of each page, instead of
+ *        pushing all 1 KiB over I2C every frame. In MONO10 the bytes are
+ *        inverted on the way out, as cfb_framebuffer_finalize does, so
+ *        the panel's REVERSE_MODE shows them the right way round.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <string.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/drivers/display.h>
+#include <zephyr/display/cfb.h>
+
+#include "disp_fb.h"
+
+LOG_MODULE_REGISTER(disp_fb, CONFIG_LOG_DEFAULT_LEVEL);
+
+static uint8_t fb[DISP_FB_PAGES][DISP_FB_WIDTH];
+static uint8_t shadow[DISP_FB_PAGES][DISP_FB_WIDTH];
+static bool shadow_valid;
+static bool inverted;
+static uint16_t x_res;
+static uint16_t pages;
+static const struct cfb_font *font;
+static struct disp_fb_stats stats;
+
+int disp_fb_init(const struct device *dev)
+{
+	struct display_capabilities caps;
+
+	display_get_capabilities(dev, &caps);
+	if (caps.x_resolution > DISP_FB_WIDTH ||
+	    caps.y_resolution > DISP_FB_PAGES * 8 ||
+	    !(caps.screen_info & SCREEN_INFO_MONO_VTILED)) {
+		LOG_ERR("Unsupported display geometry");
+		return -ENOTSUP;
+	}
+	x_res = caps.x_resolution;
+	pages = caps.y_resolution / 8;
+	inverted = (caps.current_pixel_format == PIXEL_FORMAT_MONO10);
+
+	/* Same font the character framebuffer selects by default */
+	STRUCT_SECTION_FOREACH(cfb_font, f) {
+		font = f;
+		break;
+	}
+	if (font == NULL || !(font->caps & CFB_FONT_MONO_VPACKED)) {
+		LOG_ERR("No vertically packed font available");
+		return -ENOENT;
+	}
+
+	disp_fb_clear();
+	disp_fb_invalidate();
+	return 0;
+}
+
+void disp_fb_clear(void)
+{
+	memset(fb, 0, sizeof(fb));
+}
+
+/* Force the next finalize to resend the whole frame */
+void disp_fb_invalidate(void)
+{
+	shadow_valid = false;
+}
+
+/* Raw page row for direct drawing, bit 0 of a byte is the top pixel */
+uint8_t *disp_fb_page(uint16_t page)
+{
+	return fb[page];
+}
+
+/* Character cell size of the font in use */
+void disp_fb_font_size(uint8_t *width, uint8_t *height)
+{
+	*width = font ? font->width : 0;
+	*height = font ? font->height : 8;
+}
+
+/* Draw one glyph column by column, returns the advance */
+static uint8_t draw_char(char c, uint16_t x, uint16_t y)
+{
+	const uint8_t *glyph;
+	uint8_t seg = font->height / 8U;
+
+	if (c < font->first_char || c > font->last_char) {
+		c = ' ';
+	}
+	glyph = (const uint8_t *)font->data +
+		(c - font->first_char) * (font->width * seg);
+
+	for (uint8_t g_x = 0; g_x < font->width; g_x++) {
+		for (uint8_t j = 0; j < seg; j++) {
+			uint16_t page = y / 8U + j;
+
+			if (page >= pages || x + g_x >= x_res) {
+				return 0;
+			}
+			fb[page][x + g_x] = glyph[g_x * seg + j];
+		}
+	}
+	return font->width;
+}
+
+/* Print with the same wrapping as cfb_print, y must be page aligned */
+int disp_fb_print(const char *str, uint16_t x, uint16_t y)
+{
+	if (font == NULL || (y % 8U) != 0) {
+		return -EINVAL;
+	}
+	for (; *str != '\0'; str++) {
+		if (x + font->width > x_res) {
+			x = 0U;
+			y += font->height;
+		}
+		x += draw_char(*str, x, y);
+	}
+	return 0;
+}
+
+/* Flip len bytes to the panel format and back, in place */
+static void invert(uint8_t *buf, size_t len)
+{
+	if (!inverted) {
+		return;
+	}
+	for (size_t i = 0; i < len; i++) {
+		buf[i] = ~buf[i];
+	}
+}
+
+static int write_span(const struct device *dev, uint16_t page,
+		      uint16_t x0, uint16_t x1)
+{
+	struct display_buffer_descriptor desc = {
+		.buf_size = x1 - x0,
+		.width = x1 - x0,
+		.height = 8,
+		.pitch = x1 - x0,
+	};
+	int rc;
+
+	stats.bytes_last += desc.buf_size;
+	stats.writes_last++;
+	invert(&fb[page][x0], desc.buf_size);
+	rc = display_write(dev, x0, page * 8U, &desc, &fb[page][x0]);
+	invert(&fb[page][x0], desc.buf_size);
+	return rc;
+}
+
+/* Send what changed since the last frame */
+int disp_fb_finalize(const struct device *dev)
+{
+	int rc = 0;
+
+	stats.bytes_last = 0;
+	stats.writes_last = 0;
+
+	if (!shadow_valid || !IS_ENABLED(CONFIG_APP_DISP_PARTIAL_REFRESH)) {
+		struct display_buffer_descriptor desc = {
+			.buf_size = x_res * pages,
+			.width = x_res,
+			.height = pages * 8U,
+			.pitch = x_res,
+		};
+
+		/* fb rows are DISP_FB_WIDTH apart, pack them if the panel is narrower */
+		if (x_res != DISP_FB_WIDTH) {
+			for (uint16_t p = 0; p < pages; p++) {
+				rc = write_span(dev, p, 0, x_res);
+				if (rc != 0) {
+					break;
+				}
+			}
+		} else {
+			stats.bytes_last = desc.buf_size;
+			stats.writes_last = 1;
+			invert(&fb[0][0], desc.buf_size);
+			rc = display_write(dev, 0, 0, &desc, fb);
+			invert(&fb[0][0], desc.buf_size);
+		}
+		shadow_valid = (rc == 0);
+	} else {
+		for (uint16_t p = 0; p < pages && rc == 0; p++) {
+			uint16_t x0 = 0, x1 = x_res;
+
+			while (x0 < x1 && fb[p][x0] == shadow[p][x0]) {
+				x0++;
+			}
+			while (x1 > x0 && fb[p][x1 - 1] == shadow[p][x1 - 1]) {
+				x1--;
+			}
+			if (x0 < x1) {
+				rc = write_span(dev, p, x0, x1);
+			}
+		}
+		if (rc != 0) {
+			/* Panel state unknown, resync on the next frame */
+			shadow_valid = false;
+		}
+	}
+
+	if (rc == 0) {
+		memcpy(shadow, fb, sizeof(shadow));
+	}
+	stats.frames++;
+	stats.bytes_total += stats.bytes_last;
+	LOG_DBG("frame %u: %u bytes in %u writes", stats.frames,
+		stats.bytes_last, stats.writes_last);
+	return rc;
+}
+
+void disp_fb_stats_get(struct disp_fb_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,37 @@
+/**
+ * @file disp_fb.h
+ * @author Wilfred Mallawa
+ * @brief Page framebuffer with dirty tracking, only changed column spans
+ *        of each page are sent to the display.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef DISP_FB_H
+#define DISP_FB_H
+
+#include <zephyr/device.h>
+
+#define DISP_FB_WIDTH   128
+#define DISP_FB_PAGES   8       //8 pixel rows per page
+
+/* Refresh counters */
+struct disp_fb_stats {
+    uint32_t frames;
+    uint32_t bytes_last;        //framebuffer bytes sent by the last frame
+    uint32_t bytes_total;
+    uint32_t writes_last;       //display_write calls of the last frame
+};
+
+/* Function Declarations */
+extern int disp_fb_init(const struct device *dev);
+extern void disp_fb_clear(void);
+extern int disp_fb_print(const char *str, uint16_t x, uint16_t y);
+extern int disp_fb_finalize(const struct device *dev);
+extern void disp_fb_invalidate(void);
+extern uint8_t *disp_fb_page(uint16_t page);
+extern void disp_fb_font_size(uint8_t *width, uint8_t *height);
+extern void disp_fb_stats_get(struct disp_fb_stats *stats);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,243 @@
+/**
+ * @file disp_graph.c
+ * @author Wilfred Mallawa
+ * @brief Trend graph over the last CONFIG_APP_DISP_GRAPH_MINUTES of a
+ *        history channel. One display column covers a fixed slice of time
+ *        and shows the min..max band of the samples in it, joined to its
+ *        neighbour. A column is a single 48 bit mask over the six graph
+ *        pages, so it is written as six page bytes rather than pixel by
+ *        pixel. Once drawn the graph scrolls: the page rows shift left by
+ *        one byte and only the newest column is computed, a full redraw
+ *        only happens on a screen switch or when the auto scale changes.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <string.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+
+#include "disp_graph.h"
+#include "disp_fb.h"
+#include <sens_hist.h>
+
+LOG_MODULE_REGISTER(disp_graph, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define TOP_PAGE    2               //below one line of 16 px text
+#define PAGES       (DISP_FB_PAGES - TOP_PAGE)
+#define ROWS        (PAGES * 8)
+#define COLS        DISP_FB_WIDTH
+#define SPAN_MS     (CONFIG_APP_DISP_GRAPH_MINUTES * 60U * MSEC_PER_SEC)
+#define COL_MS      (SPAN_MS / COLS)
+
+BUILD_ASSERT(ROWS <= 64, "a column must fit one 64 bit mask");
+
+/* Smallest value range plotted, so sensor noise is not blown up */
+static const int32_t min_span[] = {
+	[DISP_GRAPH_TEMP] = 100,    //1 C
+	[DISP_GRAPH_ECO2] = 50,     //50 ppm
+};
+
+static struct {
+	int chan;
+	bool valid;
+	uint32_t t_end;             //end of the newest column, ms
+	int32_t lo[COLS];
+	int32_t hi[COLS];           //lo > hi marks an empty column
+	int32_t s_min;
+	int32_t s_max;
+} g = { .chan = -1 };
+
+static struct disp_graph_stats stats;
+
+static int32_t chan_value(const struct sens_packet *p)
+{
+	return (g.chan == DISP_GRAPH_TEMP) ? p->hts221_temp : p->ccs811_eco2;
+}
+
+/* Samples without a reading of the channel leave a gap */
+static bool chan_valid(const struct sens_packet *p)
+{
+	return p->valid & ((g.chan == DISP_GRAPH_TEMP) ? SENS_VALID_HTS221 : SENS_VALID_CCS811);
+}
+
+/* Value to pixel row, row 0 at the top */
+static inline int y_of(int32_t v)
+{
+	return (ROWS - 1) - (int)((int64_t)(v - g.s_min) * (ROWS - 1) /
+				  (g.s_max - g.s_min));
+}
+
+/* Pick the scale from the visible columns, false if there is no data */
+static bool rescale(void)
+{
+	int32_t lo = INT32_MAX, hi = INT32_MIN;
+
+	for (int x = 0; x < COLS; x++) {
+		if (g.lo[x] <= g.hi[x]) {
+			lo = MIN(lo, g.lo[x]);
+			hi = MAX(hi, g.hi[x]);
+		}
+	}
+	if (lo > hi) {
+		return false;
+	}
+	if (hi - lo < min_span[g.chan]) {
+		int32_t pad = (min_span[g.chan] - (hi - lo)) / 2;
+
+		lo -= pad;
+		hi = lo + min_span[g.chan];
+	}
+	g.s_min = lo;
+	g.s_max = hi;
+	return true;
+}
+
+/* Draw column x as one word, joined to column x - 1 */
+static void draw_column(int x)
+{
+	uint64_t mask = 0;
+
+	if (g.lo[x] <= g.hi[x]) {
+		int top = y_of(g.hi[x]);
+		int bot = y_of(g.lo[x]);
+
+		if (x > 0 && g.lo[x - 1] <= g.hi[x - 1]) {
+			int ptop = y_of(g.hi[x - 1]);
+			int pbot = y_of(g.lo[x - 1]);
+
+			/* vertical connector to the previous band */
+			if (bot < ptop) {
+				bot = ptop;
+			} else if (top > pbot) {
+				top = pbot;
+			}
+		}
+		mask = (((uint64_t)2 << (bot - top)) - 1) << top;
+	}
+
+	for (int p = 0; p < PAGES; p++) {
+		disp_fb_page(TOP_PAGE + p)[x] = (uint8_t)(mask >> (8 * p));
+	}
+}
+
+/* Rebuild every column from history in one pass */
+static void draw_full(uint32_t now)
+{
+	struct sens_hist_sample s;
+	struct sens_hist_iter it;
+	int64_t start;
+
+	g.t_end = now - now % COL_MS;
+	start = (int64_t)g.t_end - SPAN_MS;
+	for (int x = 0; x < COLS; x++) {
+		g.lo[x] = INT32_MAX;
+		g.hi[x] = INT32_MIN;
+	}
+
+	sens_hist_iter_init(&it, MAX(start, 0));
+	while (sens_hist_next(&it, &s) == 0 && s.t_ms < g.t_end) {
+		int x = (s.t_ms - start) / COL_MS;
+		int32_t v = chan_value(&s.pkt);
+
+		if (x >= 0 && x < COLS && chan_valid(&s.pkt)) {
+			g.lo[x] = MIN(g.lo[x], v);
+			g.hi[x] = MAX(g.hi[x], v);
+		}
+	}
+
+	for (int p = 0; p < PAGES; p++) {
+		memset(disp_fb_page(TOP_PAGE + p), 0, COLS);
+	}
+	g.valid = rescale();
+	if (g.valid) {
+		for (int x = 0; x < COLS; x++) {
+			draw_column(x);
+		}
+	}
+}
+
+/* Append the column ending at t_end + COL_MS, false if a full redraw is due */
+static bool scroll_one(void)
+{
+	struct sens_hist_sample s;
+	struct sens_hist_iter it;
+	int32_t lo = INT32_MAX, hi = INT32_MIN;
+	uint32_t t1 = g.t_end + COL_MS;
+
+	sens_hist_iter_init(&it, g.t_end);
+	while (sens_hist_next(&it, &s) == 0 && s.t_ms < t1) {
+		int32_t v = chan_value(&s.pkt);
+
+		if (!chan_valid(&s.pkt)) {
+			continue;
+		}
+		lo = MIN(lo, v);
+		hi = MAX(hi, v);
+	}
+	g.t_end = t1;
+
+	memmove(g.lo, g.lo + 1, sizeof(g.lo[0]) * (COLS - 1));
+	memmove(g.hi, g.hi + 1, sizeof(g.hi[0]) * (COLS - 1));
+	g.lo[COLS - 1] = lo;
+	g.hi[COLS - 1] = hi;
+
+	/* Out of scale, or the old extreme scrolled off */
+	{
+		int32_t old_min = g.s_min, old_max = g.s_max;
+
+		if (!rescale() || g.s_min != old_min || g.s_max != old_max) {
+			return false;
+		}
+	}
+
+	for (int p = 0; p < PAGES; p++) {
+		uint8_t *row = disp_fb_page(TOP_PAGE + p);
+
+		memmove(row, row + 1, COLS - 1);
+	}
+	draw_column(COLS - 1);
+	return true;
+}
+
+/*
+ * Bring the graph of chan up to date in the framebuffer. Returns true if
+ * any pixel may have changed.
+ */
+bool disp_graph_draw(enum disp_graph_chan chan, bool full)
+{
+	uint32_t now = k_uptime_get_32();
+	uint32_t start = k_cycle_get_32();
+	bool drawn = false;
+
+	if (full || chan != g.chan || !g.valid) {
+		g.chan = chan;
+		full = true;
+	} else {
+		while (now >= g.t_end + COL_MS) {
+			if (!scroll_one()) {
+				full = true;
+				break;
+			}
+			drawn = true;
+		}
+		if (!full && drawn) {
+			stats.scroll_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+		}
+	}
+
+	if (full) {
+		draw_full(now);
+		stats.full_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+		stats.full_max_us = MAX(stats.full_max_us, stats.full_us);
+		LOG_DBG("graph redraw: %u us", stats.full_us);
+		drawn = true;
+	}
+	return drawn;
+}
+
+void disp_graph_stats_get(struct disp_graph_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,33 @@
+/**
+ * @file disp_graph.h
+ * @author Wilfred Mallawa
+ * @brief Scrolling trend graph of one history channel, drawn straight
+ *        into the display page buffer.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef DISP_GRAPH_H
+#define DISP_GRAPH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum disp_graph_chan {
+    DISP_GRAPH_TEMP,        //hts221, centi-celsius
+    DISP_GRAPH_ECO2,        //ppm
+};
+
+/* Draw timing, all times in us */
+struct disp_graph_stats {
+    uint32_t full_us;       //last full redraw, history decode included
+    uint32_t full_max_us;
+    uint32_t scroll_us;     //last one column scroll
+};
+
+/* Function Declarations */
+extern bool disp_graph_draw(enum disp_graph_chan chan, bool full);
+extern void disp_graph_stats_get(struct disp_graph_stats *stats);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * @file disp_layout.c
+ * @author Wilfred Mallawa
+ * @brief Screen layout engine. Labels are drawn into the framebuffer once
+ *        when a screen is switched to and then left alone. Each frame only
+ *        fields whose value changed are formatted, with plain integer
+ *        code, and redrawn in their fixed width box, so no printf and no
+ *        floating point is involved per frame.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <string.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+
+#include "disp_layout.h"
+#include "disp_fb.h"
+#include "perf.h"
+
+LOG_MODULE_REGISTER(disp_layout, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Longest field box, "H:MM:SS.mmm" with a three digit hour */
+#define FIELD_MAX 13
+
+static const struct disp_screen *shown;
+static int32_t shown_val[DISP_LAYOUT_MAX_FIELDS];
+
+/* Right align the n characters of tmp (stored reversed) in buf */
+static void emit(char *buf, uint8_t width, const char *tmp, int n)
+{
+	if (n > width) {
+		/* does not fit, flag it rather than truncate digits */
+		memset(buf, '#', width);
+	} else {
+		memset(buf, ' ', width - n);
+		for (int i = 0; i < n; i++) {
+			buf[width - 1 - i] = tmp[i];
+		}
+	}
+	buf[width] = '\0';
+}
+
+static void fmt_fixed(char *buf, uint8_t width, int32_t v, uint8_t dec)
+{
+	uint32_t u = (v < 0) ? -(uint32_t)v : (uint32_t)v;
+	char tmp[FIELD_MAX];
+	int n = 0;
+
+	for (uint8_t d = 0; d < dec; d++) {
+		tmp[n++] = '0' + u % 10U;
+		u /= 10U;
+	}
+	if (dec) {
+		tmp[n++] = '.';
+	}
+	do {
+		tmp[n++] = '0' + u % 10U;
+		u /= 10U;
+	} while (u != 0U && n < FIELD_MAX - 1);
+	if (v < 0) {
+		tmp[n++] = '-';
+	}
+	emit(buf, width, tmp, n);
+}
+
+static void fmt_clock(char *buf, uint8_t width, uint32_t ms)
+{
+	uint32_t s = ms / MSEC_PER_SEC;
+	uint32_t h = s / 3600U;
+	char tmp[FIELD_MAX];
+	int n = 0;
+
+	ms %= MSEC_PER_SEC;
+	for (int i = 0; i < 3; i++, ms /= 10U) {
+		tmp[n++] = '0' + ms % 10U;
+	}
+	tmp[n++] = '.';
+	tmp[n++] = '0' + s % 10U;
+	tmp[n++] = '0' + (s % 60U) / 10U;
+	tmp[n++] = ':';
+	tmp[n++] = '0' + (s / 60U) % 10U;
+	tmp[n++] = '0' + (s / 600U) % 6U;
+	tmp[n++] = ':';
+	do {
+		tmp[n++] = '0' + h % 10U;
+		h /= 10U;
+	} while (h != 0U && n < FIELD_MAX);
+	emit(buf, width, tmp, n);
+}
+
+/* Force the next render to redraw labels and every field */
+void disp_layout_invalidate(void)
+{
+	shown = NULL;
+}
+
+/*
+ * Bring scr up to date in the framebuffer without sending it. Returns true
+ * if anything was drawn.
+ */
+bool disp_layout_draw(const struct disp_screen *scr, const void *ctx)
+{
+	uint8_t fw, fh;
+	bool dirty = false;
+	int field = 0;
+
+	disp_fb_font_size(&fw, &fh);
+
+	if (scr != shown) {
+		/* Screen switch, lay down the static text once */
+		disp_fb_clear();
+		for (int i = 0; i < scr->count; i++) {
+			const struct disp_item *it = &scr->items[i];
+
+			if (it->type == DISP_ITEM_LABEL) {
+				disp_fb_print(it->text, it->col * fw, it->row * fh);
+			}
+		}
+		dirty = true;
+	}
+
+	for (int i = 0; i < scr->count; i++) {
+		const struct disp_item *it = &scr->items[i];
+		char buf[FIELD_MAX + 1];
+		int32_t v;
+
+		if (it->type == DISP_ITEM_LABEL) {
+			continue;
+		}
+		if (it->type == DISP_ITEM_DRAW) {
+			dirty |= it->draw(ctx, scr != shown);
+			continue;
+		}
+		if (field >= DISP_LAYOUT_MAX_FIELDS) {
+			LOG_ERR("Too many fields on screen");
+			break;
+		}
+		v = it->get(ctx);
+		if (scr == shown && v == shown_val[field]) {
+			field++;
+			continue;
+		}
+		shown_val[field++] = v;
+
+		if (it->type == DISP_ITEM_FIXED) {
+			fmt_fixed(buf, MIN(it->width, FIELD_MAX), v, it->decimals);
+		} else {
+			fmt_clock(buf, MIN(it->width, FIELD_MAX), (uint32_t)v);
+		}
+		disp_fb_print(buf, it->col * fw, it->row * fh);
+		dirty = true;
+	}
+
+	shown = scr;
+	return dirty;
+}
+
+int disp_layout_render(const struct device *dev,
+		       const struct disp_screen *scr, const void *ctx)
+{
+	int rc = 0;
+	bool dirty;
+	PERF_START(t0);
+
+	dirty = disp_layout_draw(scr, ctx);
+	PERF_STOP(PERF_DISP_DRAW, t0);
+
+	/* Nothing changed at the shown precision, nothing to send */
+	if (dirty) {
+		PERF_START(t1);
+
+		rc = disp_fb_finalize(dev);
+		PERF_STOP(PERF_DISP_SEND, t1);
+		if (rc != 0) {
+			shown = NULL;
+		}
+	}
+	return rc;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file disp_layout.h
+ * @author Wilfred Mallawa
+ * @brief Declarative screen layouts, static labels plus typed numeric
+ *        fields on a character cell grid.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef DISP_LAYOUT_H
+#define DISP_LAYOUT_H
+
+#include <zephyr/device.h>
+#include <zephyr/sys/util.h>
+
+#define DISP_LAYOUT_MAX_FIELDS  8
+
+enum disp_item_type {
+    DISP_ITEM_LABEL,            //static text, drawn once per screen switch
+    DISP_ITEM_FIXED,            //fixed-point integer, right aligned
+    DISP_ITEM_CLOCK,            //milliseconds as H:MM:SS.mmm, right aligned
+    DISP_ITEM_DRAW,             //callback drawing straight into the framebuffer
+};
+
+/* Field value source, ctx is the argument given to disp_layout_render */
+typedef int32_t (*disp_get_t)(const void *ctx);
+/* Custom drawing, full is set on a screen switch, returns true if drawn */
+typedef bool (*disp_draw_t)(const void *ctx, bool full);
+
+struct disp_item {
+    uint8_t type;
+    uint8_t col;                //character cell column
+    uint8_t row;                //character cell row
+    uint8_t width;              //field width in characters
+    uint8_t decimals;           //DISP_ITEM_FIXED decimal places of the value
+    const char *text;
+    disp_get_t get;
+    disp_draw_t draw;
+};
+
+struct disp_screen {
+    const struct disp_item *items;
+    uint8_t count;
+};
+
+#define DISP_LABEL(_col, _row, _text) \
+    { .type = DISP_ITEM_LABEL, .col = _col, .row = _row, .text = _text }
+#define DISP_FIXED(_col, _row, _width, _dec, _get) \
+    { .type = DISP_ITEM_FIXED, .col = _col, .row = _row, .width = _width, \
+      .decimals = _dec, .get = _get }
+#define DISP_CLOCK(_col, _row, _width, _get) \
+    { .type = DISP_ITEM_CLOCK, .col = _col, .row = _row, .width = _width, \
+      .get = _get }
+#define DISP_DRAW(_draw) \
+    { .type = DISP_ITEM_DRAW, .draw = _draw }
+#define DISP_SCREEN(_items) { _items, ARRAY_SIZE(_items) }
+
+/* Function Declarations */
+extern bool disp_layout_draw(const struct disp_screen *scr, const void *ctx);
+extern int disp_layout_render(const struct device *dev,
+                              const struct disp_screen *scr, const void *ctx);
+extern void disp_layout_invalidate(void);
+/* ---------------------- */
+
+#endif
@@ -2,7 +2,7 @@
  * @file main.c
  * @author Wilfred Mallawa
  * @brief Display control module, receives sensor data and
- *        uses the character frame buffer (cfb) to write to the
+ *        uses the page framebuffer (disp_fb) to write to the
  *        interfaced ssd1306 display using Zephyr device drivers.
  * @version 0.1
  * @date 2022-06-23
@@ -11,128 +11,329 @@
 #include <zephyr/zephyr.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/device.h>
-#include <zephyr/display/cfb.h>
+#include <zephyr/drivers/display.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/util.h>
 #include "display_ctl.h"
+#include "disp_fb.h"
+#include "disp_layout.h"
+#ifdef CONFIG_APP_DISP_GRAPH
+#include "disp_graph.h"
+#endif
 #include <sens.h>
+#include <sens_bus.h>
+#include <sens_stats.h>
+#include <perf.h>
 
 LOG_MODULE_REGISTER(disp_sens, CONFIG_LOG_DEFAULT_LEVEL);
 
+BUILD_ASSERT(MODE_COUNT > 0, "no display screen enabled");
+
 /* Push Button */
 #define SW0_NODE	DT_ALIAS(sw0)
 static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET_OR(SW0_NODE, gpios,
 							      {0});
 static struct gpio_callback button_cb_data;
+static struct k_work_delayable debounce_work;
+/* Raised on a debounced press, polled by the display thread */
+static struct k_poll_signal btn_signal = K_POLL_SIGNAL_INITIALIZER(btn_signal);
+/* Cycle count of the first edge of the current press */
+static uint32_t press_cyc;
+static struct disp_latency btn_latency;
+static struct disp_latency e2e_latency;
+/* Packets superseded before the display got to them */
+static uint32_t skipped;
 /* Governs the data display mode */
-static uint8_t disp_mode = 0;
+static volatile uint8_t disp_mode = 0;
 
 /* [WIP] Displays the boot splash and hw init status */
 int disp_splash_screen(const struct device *dev) {
     int rc = 0;
     //! TODO: Actually check these params */
-    if ((rc = cfb_print(dev,"sys_init OK sys_sens OK sys_boot OK starting ...", 0, 0)) != 0) {
-        LOG_ERR("Failed to update a cfb\n");
+    if ((rc = disp_fb_print("sys_init OK sys_sens OK sys_boot OK starting ...", 0, 0)) != 0) {
+        LOG_ERR("Failed to update the framebuffer\n");
     }
-    cfb_framebuffer_finalize(dev);
+    disp_fb_finalize(dev);
 
     k_msleep(SPLASH_DELAY1);
 
-    cfb_framebuffer_clear(dev, true);
+    disp_fb_clear();
 
-    if ((rc = cfb_print(dev,"-WELCOME-", 16, 16)) != 0) {
-        LOG_ERR("Failed to update a cfb\n");
+    if ((rc = disp_fb_print("-WELCOME-", 16, 16)) != 0) {
+        LOG_ERR("Failed to update the framebuffer\n");
     }
-    cfb_framebuffer_finalize(dev);
+    disp_fb_finalize(dev);
     k_msleep(SPLASH_DELAY1);
+    /* the screen under the splash is gone */
+    disp_layout_invalidate();
     return rc;
 }
 
-/* returns a formatted string that contains current uptime */
-static const char *now_str(void)
+/* Field getters, ctx is the sens_packet being shown */
+#ifdef CONFIG_APP_DISP_SCREEN_CLIMATE
+static int32_t get_temp(const void *ctx)
 {
-	static char buf[16]; /* ...HH:MM:SS.MMM */
-	uint32_t now = k_uptime_get_32();
-	unsigned int ms = now % MSEC_PER_SEC;
-	unsigned int s;
-	unsigned int min;
-	unsigned int h;
+    const struct sens_packet *p = ctx;
 
-	now /= MSEC_PER_SEC;
-	s = now % 60U;
-	now /= 60U;
-	min = now % 60U;
-	now /= 60U;
-	h = now;
+    /* mean of both sensors, centi to tenths */
+    return (p->hts221_temp + p->lps22hb_temp) / 20;
+}
 
-	snprintk(buf, sizeof(buf), "%u:%02u:%02u.%03u",
-		 h, min, s, ms);
-	return buf;
+static int32_t get_rh(const void *ctx)
+{
+    return ((const struct sens_packet *)ctx)->hts221_rh / 10;
 }
 
-/* displays current climate date (temp/hum/pressure) */
-int disp_sens_temps(const struct device *dev, struct sens_packet *data) {
-    char draw_str[64];
-    int rc = 0;
-    /* the '\n' are for formatting on display */
-    snprintk(draw_str, 64, "Temp: %.1fC RHum: %.1f%% Pressure:     %.1fkPa",
-        ((data->hts221_temp + data->lps22hb_temp) / 2.0), data->hts221_rh, data->lps22hb_press);
+static int32_t get_press(const void *ctx)
+{
+    /* Pa to tenths of kPa */
+    return ((const struct sens_packet *)ctx)->lps22hb_press / 100;
+}
+#endif /* CONFIG_APP_DISP_SCREEN_CLIMATE */
 
-    cfb_framebuffer_clear(dev, true);
-    LOG_DBG("Displaying: [%s]", draw_str);
+#if defined(CONFIG_APP_DISP_SCREEN_AIRQ) || \
+    (defined(CONFIG_APP_DISP_GRAPH) && defined(CONFIG_APP_SENS_CCS811))
+static int32_t get_eco2(const void *ctx)
+{
+    return ((const struct sens_packet *)ctx)->ccs811_eco2;
+}
+#endif
 
-    if ((rc = cfb_print(dev, draw_str, 0, 0)) != 0) {
-        LOG_ERR("Failed to update a cfb\n");
-    }
-    cfb_framebuffer_finalize(dev);
-    return rc;
+#ifdef CONFIG_APP_DISP_SCREEN_AIRQ
+static int32_t get_etvoc(const void *ctx)
+{
+    return ((const struct sens_packet *)ctx)->ccs811_etvoc;
 }
+#endif /* CONFIG_APP_DISP_SCREEN_AIRQ */
 
-/* displays only system-stats metrics */
-int disp_sys_stat(const struct device *dev, struct sens_packet *data) {
-    char draw_str[64];
-    int rc = 0;
-    /* the '\n' are for formatting on display */
-    snprintk(draw_str, 64, "Batt: %dmVUptime:     %s" , data->batt_mV, now_str());
+#ifdef CONFIG_APP_DISP_SCREEN_SYS
+static int32_t get_batt(const void *ctx)
+{
+    return ((const struct sens_packet *)ctx)->batt_mV;
+}
 
-    cfb_framebuffer_clear(dev, true);
-    LOG_DBG("Displaying: [%s]", draw_str);
+static int32_t get_batt_lvl(const void *ctx)
+{
+    /* pptt to tenths of a percent */
+    return ((const struct sens_packet *)ctx)->batt_pptt / 10;
+}
 
-    if ((rc = cfb_print(dev, draw_str, 0, 0)) != 0) {
-        LOG_ERR("Failed to update a cfb\n");
-    }
-    cfb_framebuffer_finalize(dev);
-    return rc;
+static int32_t get_uptime(const void *ctx)
+{
+    ARG_UNUSED(ctx);
+    return k_uptime_get_32();
 }
+#endif /* CONFIG_APP_DISP_SCREEN_SYS */
 
-/* display only air-quality metrics */
-int disp_sens_airq(const struct device *dev, struct sens_packet *data) {
-    char draw_str[64];
-    int rc = 0;
-    /* the '\n' are for formatting on display */
-    snprintk(draw_str, 64, "eCO2:\n\n\n\n\n\n\n\n\n%u ppm\n\n etVOC:\n\n\n\n\n\n\n\n%u ppb",
-        data->ccs811_eco2, data->ccs811_etvoc);
+#ifdef CONFIG_APP_DISP_SCREEN_TRENDS
+static int32_t get_stat(enum sens_stat_chan chan, bool max)
+{
+    struct sens_stat st = {0};
 
-    cfb_framebuffer_clear(dev, true);
-    LOG_DBG("Displaying: [%s]", draw_str);
+#ifdef CONFIG_APP_SENS_STATS
+    sens_stats_get(chan, SENS_STAT_1H, &st);
+#endif
+    return max ? st.max : st.min;
+}
 
-    if ((rc = cfb_print(dev, draw_str, 0, 0)) != 0) {
-        LOG_ERR("Failed to update a cfb\n");
-    }
-    cfb_framebuffer_finalize(dev);
-    return rc;
+static int32_t get_temp_lo(const void *ctx)
+{
+    ARG_UNUSED(ctx);
+    return get_stat(SENS_STAT_TEMP, false) / 10;
 }
 
-/* pb call back handler, to increment the display mode as
- * require to toggle the modes
+static int32_t get_temp_hi(const void *ctx)
+{
+    ARG_UNUSED(ctx);
+    return get_stat(SENS_STAT_TEMP, true) / 10;
+}
+
+static int32_t get_eco2_avg(const void *ctx)
+{
+    struct sens_stat st = {0};
+
+    ARG_UNUSED(ctx);
+#ifdef CONFIG_APP_SENS_STATS
+    sens_stats_get(SENS_STAT_ECO2, SENS_STAT_1H, &st);
+#endif
+    return st.mean;
+}
+#endif /* CONFIG_APP_DISP_SCREEN_TRENDS */
+
+#ifdef CONFIG_APP_DISP_GRAPH
+static bool draw_graph(enum disp_graph_chan chan, bool full)
+{
+    bool drawn;
+    PERF_START(t0);
+
+    drawn = disp_graph_draw(chan, full);
+    PERF_STOP(PERF_DISP_GRAPH, t0);
+    return drawn;
+}
+
+#ifdef CONFIG_APP_SENS_HTS221
+static int32_t get_hts221_temp(const void *ctx)
+{
+    return ((const struct sens_packet *)ctx)->hts221_temp / 10;
+}
+
+static bool draw_graph_temp(const void *ctx, bool full)
+{
+    ARG_UNUSED(ctx);
+    return draw_graph(DISP_GRAPH_TEMP, full);
+}
+#endif
+
+#ifdef CONFIG_APP_SENS_CCS811
+static bool draw_graph_eco2(const void *ctx, bool full)
+{
+    ARG_UNUSED(ctx);
+    return draw_graph(DISP_GRAPH_ECO2, full);
+}
+#endif
+#endif /* CONFIG_APP_DISP_GRAPH */
+
+/* Screen layouts, in character cells of the 12x4 grid */
+#ifdef CONFIG_APP_DISP_SCREEN_CLIMATE
+/* current climate data (temp/hum/pressure) */
+static const struct disp_item temps_items[] = {
+    DISP_LABEL(0, 0, "Temp:"),
+    DISP_FIXED(5, 0, 6, 1, get_temp),
+    DISP_LABEL(11, 0, "C"),
+    DISP_LABEL(0, 1, "RHum:"),
+    DISP_FIXED(5, 1, 6, 1, get_rh),
+    DISP_LABEL(11, 1, "%"),
+    DISP_LABEL(0, 2, "Pressure:"),
+    DISP_FIXED(1, 3, 7, 1, get_press),
+    DISP_LABEL(9, 3, "kPa"),
+};
+#endif
+
+#ifdef CONFIG_APP_DISP_SCREEN_AIRQ
+/* air-quality metrics */
+static const struct disp_item airq_items[] = {
+    DISP_LABEL(0, 0, "eCO2:"),
+    DISP_FIXED(1, 1, 6, 0, get_eco2),
+    DISP_LABEL(8, 1, "ppm"),
+    DISP_LABEL(0, 2, "etVOC:"),
+    DISP_FIXED(1, 3, 6, 0, get_etvoc),
+    DISP_LABEL(8, 3, "ppb"),
+};
+#endif
+
+#ifdef CONFIG_APP_DISP_SCREEN_SYS
+/* system-stats metrics */
+static const struct disp_item sys_items[] = {
+    DISP_LABEL(0, 0, "Batt:"),
+    DISP_FIXED(5, 0, 5, 0, get_batt),
+    DISP_LABEL(10, 0, "mV"),
+    DISP_LABEL(0, 1, "Uptime:"),
+    DISP_CLOCK(0, 2, 12, get_uptime),
+    DISP_LABEL(0, 3, "Lvl:"),
+    DISP_FIXED(6, 3, 5, 1, get_batt_lvl),
+    DISP_LABEL(11, 3, "%"),
+};
+#endif
+
+#ifdef CONFIG_APP_DISP_SCREEN_TRENDS
+/* 1h climate trends (temp range, eCO2 mean) */
+static const struct disp_item trends_items[] = {
+    DISP_LABEL(0, 0, "1h Lo:"),
+    DISP_FIXED(6, 0, 5, 1, get_temp_lo),
+    DISP_LABEL(11, 0, "C"),
+    DISP_LABEL(0, 1, "1h Hi:"),
+    DISP_FIXED(6, 1, 5, 1, get_temp_hi),
+    DISP_LABEL(11, 1, "C"),
+    DISP_LABEL(0, 2, "CO2 1h avg:"),
+    DISP_FIXED(1, 3, 6, 0, get_eco2_avg),
+    DISP_LABEL(8, 3, "ppm"),
+};
+#endif
+
+/* trend graphs, current value on top, graph on the lower 48 px */
+#if defined(CONFIG_APP_DISP_GRAPH) && defined(CONFIG_APP_SENS_HTS221)
+static const struct disp_item graph_temp_items[] = {
+    DISP_LABEL(0, 0, "T"),
+    DISP_FIXED(5, 0, 6, 1, get_hts221_temp),
+    DISP_LABEL(11, 0, "C"),
+    DISP_DRAW(draw_graph_temp),
+};
+#endif
+
+#if defined(CONFIG_APP_DISP_GRAPH) && defined(CONFIG_APP_SENS_CCS811)
+static const struct disp_item graph_eco2_items[] = {
+    DISP_LABEL(0, 0, "CO2"),
+    DISP_FIXED(4, 0, 5, 0, get_eco2),
+    DISP_LABEL(9, 0, "ppm"),
+    DISP_DRAW(draw_graph_eco2),
+};
+#endif
+
+/* Indexed by disp_mode */
+static const struct disp_screen screens[MODE_COUNT] = {
+#ifdef CONFIG_APP_DISP_SCREEN_CLIMATE
+    [MODE_TEMPS] = DISP_SCREEN(temps_items),
+#endif
+#ifdef CONFIG_APP_DISP_SCREEN_AIRQ
+    [MODE_AIR_QUAL] = DISP_SCREEN(airq_items),
+#endif
+#ifdef CONFIG_APP_DISP_SCREEN_SYS
+    [MODE_STATS] = DISP_SCREEN(sys_items),
+#endif
+#ifdef CONFIG_APP_DISP_SCREEN_TRENDS
+    [MODE_TRENDS] = DISP_SCREEN(trends_items),
+#endif
+#if defined(CONFIG_APP_DISP_GRAPH) && defined(CONFIG_APP_SENS_HTS221)
+    [MODE_GRAPH_TEMP] = DISP_SCREEN(graph_temp_items),
+#endif
+#if defined(CONFIG_APP_DISP_GRAPH) && defined(CONFIG_APP_SENS_CCS811)
+    [MODE_GRAPH_ECO2] = DISP_SCREEN(graph_eco2_items),
+#endif
+};
+
+/* pb debounce expiry, the press counts if the pin settled active, then
+ * increment the display mode as require to toggle the modes
  */
-void button_pressed(const struct device *dev, struct gpio_callback *cb,
-		    uint32_t pins)
+static void button_debounced(struct k_work *work)
 {
+    if (gpio_pin_get_dt(&button) != 1) {
+        return;
+    }
 	LOG_DBG("Increment display toggle");
     disp_mode++;
-    if (disp_mode > 2)
+    if (disp_mode >= MODE_COUNT)
         disp_mode = 0;
+    k_poll_signal_raise(&btn_signal, 0);
+}
+
+/* pb call back handler, every bounce restarts the debounce window */
+void button_pressed(const struct device *dev, struct gpio_callback *cb,
+		    uint32_t pins)
+{
+    if (!k_work_delayable_is_pending(&debounce_work)) {
+        press_cyc = k_cycle_get_32();
+    }
+    k_work_reschedule(&debounce_work, K_MSEC(CONFIG_APP_DISP_DEBOUNCE_MS));
+}
+
+void disp_btn_latency_get(struct disp_latency *lat)
+{
+    *lat = btn_latency;
+}
+
+void disp_e2e_latency_get(struct disp_latency *lat)
+{
+    *lat = e2e_latency;
+}
+
+uint32_t disp_skipped_get(void)
+{
+    return skipped;
+}
+
+const struct disp_screen *disp_screen_get(uint8_t mode)
+{
+    return (mode < MODE_COUNT) ? &screens[mode] : NULL;
 }
 
 /* Init pb gpio and cb interrupt */
@@ -158,6 +359,7 @@ int init_pb_cb(void) {
 		return rc;
 	}
 
+	k_work_init_delayable(&debounce_work, button_debounced);
 	gpio_init_callback(&button_cb_data, button_pressed, BIT(button.pin));
 	gpio_add_callback(button.port, &button_cb_data);
 
@@ -173,7 +375,9 @@ void disp_ctl_thread(void *unused1, void *unused2, void *unused3)
     LOG_INF("Check display");
 
     const struct device *dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
-    struct sens_packet sens_data = {0};
+    static struct sens_bus_sub sens_sub;
+    const struct sens_packet *sens_data;
+    struct k_poll_event events[2];
 
     if (init_pb_cb() != 0) {
         LOG_ERR("gpio: pb setup error");
@@ -192,12 +396,13 @@ void disp_ctl_thread(void *unused1, void *unused2, void *unused3)
 
     LOG_INF("Initialized OK");
 
-	if (cfb_framebuffer_init(dev)) {
+	if (disp_fb_init(dev)) {
 		LOG_ERR("Framebuffer initialization failed!\n");
 		return;
 	}
 
-	cfb_framebuffer_clear(dev, true);
+	disp_fb_clear();
+	disp_fb_finalize(dev);
 
 	display_blanking_off(dev);
 
@@ -207,21 +412,63 @@ void disp_ctl_thread(void *unused1, void *unused2, void *unused3)
 
     k_msleep(SPLASH_DELAY);
 
+    sens_bus_subscribe(&sens_sub);
+    k_poll_event_init(&events[0], K_POLL_TYPE_SEM_AVAILABLE,
+                      K_POLL_MODE_NOTIFY_ONLY, &sens_sub.sem);
+    k_poll_event_init(&events[1], K_POLL_TYPE_SIGNAL,
+                      K_POLL_MODE_NOTIFY_ONLY, &btn_signal);
+
     while(1) {
-        /* Receive a sensor packet buffer */
-        /* Wait here until a packet is received */
-        if (k_msgq_get(&sens_q, &sens_data, K_FOREVER) == 0) {
+        bool pressed = false;
+        uint32_t shown_seq;
+        bool fresh;
+
+        /* Wait here until a packet is published or the button is pressed */
+        k_poll(events, ARRAY_SIZE(events), K_FOREVER);
+        if (events[1].state == K_POLL_STATE_SIGNALED) {
+            k_poll_signal_reset(&btn_signal);
+            pressed = true;
+        }
+        events[0].state = K_POLL_STATE_NOT_READY;
+        events[1].state = K_POLL_STATE_NOT_READY;
+
+        /* Render the newest packet, or redraw the current one on a press */
+        shown_seq = sens_sub.seq;
+        sens_data = sens_bus_get_latest(&sens_sub, K_NO_WAIT);
+        fresh = (sens_data != NULL && sens_sub.seq == sens_bus_seq());
+        if (sens_data != NULL && shown_seq != 0) {
+            /* Published while the last frame was being drawn */
+            skipped += sens_sub.seq - shown_seq - 1;
+        }
+        if (sens_data == NULL) {
+            sens_data = sens_bus_peek(&sens_sub);
+        }
+        if (sens_data != NULL) {
             LOG_DBG("Updating display with new sensor data");
-            if (disp_mode == MODE_TEMPS) {
-                disp_sens_temps(dev, &sens_data);
-            } else if (disp_mode == MODE_AIR_QUAL) {
-                disp_sens_airq(dev, &sens_data);
-            } else if (disp_mode == MODE_STATS) {
-                disp_sys_stat(dev, &sens_data);
+            if (disp_layout_render(dev, &screens[disp_mode], sens_data) != 0) {
+                LOG_ERR("Failed to update the framebuffer\n");
+            }
+            if (!sens_bus_release(&sens_sub)) {
+                LOG_DBG("Packet recycled while rendering");
             }
         }
 
-        memset(&sens_data, 0, sizeof(struct sens_packet));
-        k_msleep(DISP_UPDATE_DELAY);
+        if (fresh) {
+            /* Start of the sample cycle to the frame sent */
+            struct sens_acq_stats acq;
+
+            sens_acq_stats_get(&acq);
+            e2e_latency.last_us = k_cyc_to_us_floor32(k_cycle_get_32() - acq.start_cyc);
+            e2e_latency.max_us = MAX(e2e_latency.max_us, e2e_latency.last_us);
+            e2e_latency.count++;
+        }
+
+        if (pressed) {
+            /* Edge to pixels on the panel, debounce window included */
+            btn_latency.last_us = k_cyc_to_us_floor32(k_cycle_get_32() - press_cyc);
+            btn_latency.max_us = MAX(btn_latency.max_us, btn_latency.last_us);
+            btn_latency.count++;
+            LOG_DBG("button to pixel: %u us", btn_latency.last_us);
+        }
     }
-}
\ No newline at end of file
+}
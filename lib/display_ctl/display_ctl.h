@@ -9,14 +9,42 @@
 #define DISPLAY_CTL_H
 
 /* Sensor Thread Details */
-#define DISP_T_STACK_SIZE   2048
+#define DISP_T_STACK_SIZE   CONFIG_APP_DISP_STACK_SIZE
 #define DISP_T_PRIOR        2
 #define SPLASH_DELAY        500     //ms
 #define SPLASH_DELAY1       1000    //ms
-#define DISP_UPDATE_DELAY   1000    //ms
-#define MODE_TEMPS          0
-#define MODE_AIR_QUAL       1
-#define MODE_STATS          2
+
+/* Screens built in, in button order, see the APP_DISP_SCREEN_* options */
+enum {
+#ifdef CONFIG_APP_DISP_SCREEN_CLIMATE
+    MODE_TEMPS,
+#endif
+#ifdef CONFIG_APP_DISP_SCREEN_AIRQ
+    MODE_AIR_QUAL,
+#endif
+#ifdef CONFIG_APP_DISP_SCREEN_SYS
+    MODE_STATS,
+#endif
+#ifdef CONFIG_APP_DISP_SCREEN_TRENDS
+    MODE_TRENDS,
+#endif
+#if defined(CONFIG_APP_DISP_GRAPH) && defined(CONFIG_APP_SENS_HTS221)
+    MODE_GRAPH_TEMP,
+#endif
+#if defined(CONFIG_APP_DISP_GRAPH) && defined(CONFIG_APP_SENS_CCS811)
+    MODE_GRAPH_ECO2,
+#endif
+    MODE_COUNT,
+};
+
+/* Button press or sample cycle start to rendered frame, all times in us */
+struct disp_latency {
+    uint32_t last_us;
+    uint32_t max_us;
+    uint32_t count;
+};
+
+struct disp_screen;
 
 extern struct k_thread disp_t_data;
 extern k_tid_t disp_tid;
@@ -24,6 +52,10 @@ extern k_tid_t disp_tid;
 
 /* Function Declarations */
 extern void disp_ctl_thread(void *, void *, void *);
+extern void disp_btn_latency_get(struct disp_latency *lat);
+extern void disp_e2e_latency_get(struct disp_latency *lat);
+extern uint32_t disp_skipped_get(void);
+extern const struct disp_screen *disp_screen_get(uint8_t mode);
 /* ---------------------- */
 
 #endif
\ No newline at end of file
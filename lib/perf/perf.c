@@ -0,0 +1,284 @@
+/**
+ * @file perf.c
+ * @author Wilfred Mallawa
+ * @brief Performance counters behind the 'perf' shell commands: min, avg
+ *        and max cycles of each probed stage, CPU share and stack high
+ *        water mark of every thread, packets dropped along the pipeline
+ *        and the traffic of each I2C bus.
+ *
+ *          perf stages     per stage latency, CSV
+ *          perf threads    CPU share since the last call, stack use
+ *          perf drops      lost packets, skipped frames, missed deadlines
+ *          perf i2c        transfers and bytes per bus (CONFIG_I2C_STATS)
+ *          perf reset      zero the stage counters
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <string.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/shell/shell.h>
+#ifdef CONFIG_I2C_STATS
+#include <zephyr/drivers/i2c.h>
+#endif
+
+#include "perf.h"
+#include <sens.h>
+#include <display_ctl.h>
+#ifdef CONFIG_APP_SENS_HIST
+#include <sens_hist.h>
+#endif
+#ifdef CONFIG_APP_SENS_LOG
+#include <sens_log.h>
+#endif
+#ifdef CONFIG_APP_SENS_TELEM
+#include <sens_telem.h>
+#endif
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+#include <sens_accel.h>
+#endif
+
+#define THREADS_MAX 16
+
+BUILD_ASSERT(PERF_PROC(SENS_SRC_COUNT) == PERF_SENS_CYCLE,
+	     "a process probe per acquisition source");
+
+static const char *const probe_names[PERF_PROBE_COUNT] = {
+	[PERF_PROC_HTS221] = "proc_hts221",
+	[PERF_PROC_LPS22HB] = "proc_lps22hb",
+	[PERF_PROC_LIS2DH] = "proc_lis2dh",
+	[PERF_PROC_BATT] = "proc_batt",
+	[PERF_PROC_CCS811] = "proc_ccs811",
+	[PERF_SENS_CYCLE] = "sens_cycle",
+	[PERF_DISP_DRAW] = "disp_draw",
+	[PERF_DISP_GRAPH] = "disp_graph",
+	[PERF_DISP_SEND] = "disp_send",
+};
+
+static struct perf_stage stages[PERF_PROBE_COUNT];
+static struct k_spinlock lock;
+
+void perf_record(enum perf_probe probe, uint32_t cyc)
+{
+	struct perf_stage *s = &stages[probe];
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (s->count == 0 || cyc < s->min_cyc) {
+		s->min_cyc = cyc;
+	}
+	s->max_cyc = MAX(s->max_cyc, cyc);
+	s->total_cyc += cyc;
+	s->count++;
+	k_spin_unlock(&lock, key);
+}
+
+void perf_stage_get(enum perf_probe probe, struct perf_stage *stage)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*stage = stages[probe];
+	k_spin_unlock(&lock, key);
+}
+
+void perf_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	memset(stages, 0, sizeof(stages));
+	k_spin_unlock(&lock, key);
+}
+
+static int cmd_stages(const struct shell *sh, size_t argc, char **argv)
+{
+	struct perf_stage s;
+
+	shell_print(sh, "stage,count,min_us,avg_us,max_us");
+	for (int i = 0; i < PERF_PROBE_COUNT; i++) {
+		perf_stage_get(i, &s);
+		if (s.count == 0) {
+			continue;
+		}
+		shell_print(sh, "%s,%u,%u,%u,%u", probe_names[i], s.count,
+			    k_cyc_to_us_floor32(s.min_cyc),
+			    (uint32_t)k_cyc_to_us_floor64(s.total_cyc / s.count),
+			    k_cyc_to_us_floor32(s.max_cyc));
+	}
+	return 0;
+}
+
+static int cmd_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	perf_reset();
+	return 0;
+}
+
+/* Thread snapshot, taken without the scheduler lock held while printing */
+struct thread_snap {
+	const struct k_thread *thread;
+	char name[CONFIG_THREAD_MAX_NAME_LEN];
+	uint64_t cycles;
+	size_t size;
+	size_t unused;
+};
+
+static struct thread_snap snap[THREADS_MAX];
+static size_t snap_count;
+
+/* Cycles each thread had at the previous 'perf threads' */
+static struct {
+	const struct k_thread *thread;
+	uint64_t cycles;
+} prev[THREADS_MAX];
+
+static void thread_collect(const struct k_thread *thread, void *user_data)
+{
+	struct thread_snap *t;
+	k_thread_runtime_stats_t rt;
+	const char *name;
+
+	if (snap_count == ARRAY_SIZE(snap)) {
+		return;
+	}
+	t = &snap[snap_count++];
+	t->thread = thread;
+	name = k_thread_name_get((k_tid_t)thread);
+	snprintk(t->name, sizeof(t->name), "%s", (name && name[0]) ? name : "?");
+	t->cycles = (k_thread_runtime_stats_get((k_tid_t)thread, &rt) == 0) ?
+		    rt.execution_cycles : 0;
+	t->size = thread->stack_info.size;
+	if (k_thread_stack_space_get(thread, &t->unused) != 0) {
+		t->unused = t->size;
+	}
+}
+
+static uint64_t prev_cycles(const struct k_thread *thread)
+{
+	for (int i = 0; i < ARRAY_SIZE(prev); i++) {
+		if (prev[i].thread == thread) {
+			return prev[i].cycles;
+		}
+	}
+	return 0;
+}
+
+static int cmd_threads(const struct shell *sh, size_t argc, char **argv)
+{
+	uint64_t delta[THREADS_MAX];
+	uint64_t total = 0;
+
+	snap_count = 0;
+	k_thread_foreach_unlocked(thread_collect, NULL);
+
+	for (size_t i = 0; i < snap_count; i++) {
+		delta[i] = snap[i].cycles - prev_cycles(snap[i].thread);
+		total += delta[i];
+	}
+	memset(prev, 0, sizeof(prev));
+	for (size_t i = 0; i < snap_count; i++) {
+		prev[i].thread = snap[i].thread;
+		prev[i].cycles = snap[i].cycles;
+	}
+
+	shell_print(sh, "thread             cpu%%   stack used/size");
+	for (size_t i = 0; i < snap_count; i++) {
+		const struct thread_snap *t = &snap[i];
+		uint32_t pm = total ? (uint32_t)(delta[i] * 1000 / total) : 0;
+		size_t used = t->size - t->unused;
+
+		shell_print(sh, "%-16s %3u.%u   %5u/%-5u %3u%%", t->name, pm / 10,
+			    pm % 10, (uint32_t)used, (uint32_t)t->size,
+			    t->size ? (uint32_t)(used * 100 / t->size) : 0);
+	}
+	return 0;
+}
+
+static int cmd_drops(const struct shell *sh, size_t argc, char **argv)
+{
+	uint32_t missed = 0;
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		missed += sens_sched_missed_get(i);
+	}
+	shell_print(sh, "sched_missed:   %u deadlines", missed);
+#ifdef CONFIG_APP_DISP
+	shell_print(sh, "disp_skipped:   %u packets", disp_skipped_get());
+#endif
+#ifdef CONFIG_APP_SENS_HIST
+	{
+		struct sens_hist_stats st;
+
+		sens_hist_stats_get(&st);
+		shell_print(sh, "hist_dropped:   %u samples", st.dropped);
+	}
+#endif
+#ifdef CONFIG_APP_SENS_LOG
+	{
+		struct sens_log_stats st;
+
+		sens_log_stats_get(&st);
+		shell_print(sh, "log_dropped:    %u records", st.dropped);
+	}
+#endif
+#ifdef CONFIG_APP_SENS_TELEM
+	{
+		struct sens_telem_stats st;
+
+		sens_telem_stats_get(&st);
+		shell_print(sh, "telem_dropped:  %u packets, %u frames", st.dropped,
+			    st.write_errors);
+	}
+#endif
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+	{
+		struct sens_accel_stats st;
+
+		sens_accel_stats_get(&st);
+		shell_print(sh, "accel_overrun:  %u batches", st.overruns);
+	}
+#endif
+	return 0;
+}
+
+#ifdef CONFIG_I2C_STATS
+#define PERF_I2C_BUS(n) COND_CODE_1(DT_NODE_HAS_STATUS(DT_NODELABEL(n), okay), \
+	({ #n, DEVICE_DT_GET(DT_NODELABEL(n)) },), ())
+
+static const struct {
+	const char *name;
+	const struct device *dev;
+} i2c_buses[] = {
+	PERF_I2C_BUS(i2c0)
+	PERF_I2C_BUS(i2c1)
+};
+
+static int cmd_i2c(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "bus,transfers,messages,bytes_read,bytes_written");
+	for (int i = 0; i < ARRAY_SIZE(i2c_buses); i++) {
+		const struct i2c_device_state *st =
+			CONTAINER_OF(i2c_buses[i].dev->state, struct i2c_device_state,
+				     devstate);
+
+		shell_print(sh, "%s,%u,%u,%u,%u", i2c_buses[i].name,
+			    st->stats.transfer_call_count, st->stats.message_count,
+			    st->stats.bytes_read, st->stats.bytes_written);
+	}
+	return 0;
+}
+#endif /* CONFIG_I2C_STATS */
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_perf,
+	SHELL_CMD(stages, NULL, "Per stage min, avg, max latency, CSV", cmd_stages),
+	SHELL_CMD(threads, NULL, "CPU share since last call and stack use", cmd_threads),
+	SHELL_CMD(drops, NULL, "Packets and deadlines lost along the pipeline", cmd_drops),
+#ifdef CONFIG_I2C_STATS
+	SHELL_CMD(i2c, NULL, "Transfers and bytes per I2C bus", cmd_i2c),
+#endif
+	SHELL_CMD(reset, NULL, "Zero the stage counters", cmd_reset),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(perf, &sub_perf, "Performance counters", NULL);
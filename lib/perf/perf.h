@@ -0,0 +1,57 @@
+/**
+ * @file perf.h
+ * @author Wilfred Mallawa
+ * @brief Cycle counter probes around the sample processing and render
+ *        stages, read back by the 'perf' shell commands. Without
+ *        CONFIG_APP_PERF the probes compile to nothing.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include <zephyr/zephyr.h>
+
+#include "sens.h"
+
+/* Probed stages, the process ones in enum sens_src order */
+enum perf_probe {
+    PERF_PROC_HTS221,
+    PERF_PROC_LPS22HB,
+    PERF_PROC_LIS2DH,
+    PERF_PROC_BATT,
+    PERF_PROC_CCS811,
+    PERF_SENS_CYCLE,        //fetch and process, one sample cycle
+    PERF_DISP_DRAW,         //layout into the framebuffer, graphs included
+    PERF_DISP_GRAPH,
+    PERF_DISP_SEND,         //changed spans to the panel
+    PERF_PROBE_COUNT,
+};
+
+#define PERF_PROC(src) ((enum perf_probe)(PERF_PROC_HTS221 + (src)))
+
+/* Cycles spent in one stage */
+struct perf_stage {
+    uint32_t count;
+    uint32_t min_cyc;
+    uint32_t max_cyc;
+    uint64_t total_cyc;
+};
+
+#ifdef CONFIG_APP_PERF
+#define PERF_START(_t)          uint32_t _t = k_cycle_get_32()
+#define PERF_STOP(_probe, _t)   perf_record(_probe, k_cycle_get_32() - (_t))
+#else
+#define PERF_START(_t)
+#define PERF_STOP(_probe, _t)
+#endif
+
+/* Function Declarations */
+extern void perf_record(enum perf_probe probe, uint32_t cyc);
+extern void perf_stage_get(enum perf_probe probe, struct perf_stage *stage);
+extern void perf_reset(void);
+/* ---------------------- */
+
+#endif
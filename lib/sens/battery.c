@@ -5,7 +5,6 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -184,40 +183,78 @@ int battery_measure_enable(bool enable)
 	return rc;
 }
 
+bool battery_ready(void)
+{
+	return battery_ok;
+}
+
+unsigned int battery_divider_ohm(void)
+{
+	return battery_ok ? divider_config.full_ohm : 0;
+}
+
+/* Convert the last completed conversion to millivolts */
+int battery_sample_result(void)
+{
+	struct divider_data *ddp = &divider_data;
+	const struct divider_config *dcp = &divider_config;
+	struct adc_sequence *sp = &ddp->adc_seq;
+	int32_t val = ddp->raw;
+	int rc;
+
+	adc_raw_to_millivolts(adc_ref_internal(ddp->adc),
+			      ddp->adc_cfg.gain,
+			      sp->resolution,
+			      &val);
+
+	if (dcp->output_ohm != 0) {
+		rc = val * (uint64_t)dcp->full_ohm
+			/ dcp->output_ohm;
+		LOG_DBG("raw %u ~ %u mV => %d mV\n",
+			ddp->raw, val, rc);
+	} else {
+		rc = val;
+		LOG_DBG("raw %u ~ %u mV\n", ddp->raw, val);
+	}
+	return rc;
+}
+
 int battery_sample(void)
 {
 	int rc = -ENOENT;
 
 	if (battery_ok) {
 		struct divider_data *ddp = &divider_data;
-		const struct divider_config *dcp = &divider_config;
 		struct adc_sequence *sp = &ddp->adc_seq;
 
 		rc = adc_read(ddp->adc, sp);
 		sp->calibrate = false;
 		if (rc == 0) {
-			int32_t val = ddp->raw;
-
-			adc_raw_to_millivolts(adc_ref_internal(ddp->adc),
-					      ddp->adc_cfg.gain,
-					      sp->resolution,
-					      &val);
-
-			if (dcp->output_ohm != 0) {
-				rc = val * (uint64_t)dcp->full_ohm
-					/ dcp->output_ohm;
-				LOG_INF("raw %u ~ %u mV => %d mV\n",
-					ddp->raw, val, rc);
-			} else {
-				rc = val;
-				LOG_INF("raw %u ~ %u mV\n", ddp->raw, val);
-			}
+			rc = battery_sample_result();
 		}
 	}
 
 	return rc;
 }
 
+#ifdef CONFIG_ADC_ASYNC
+int battery_sample_async(struct k_poll_signal *done)
+{
+	int rc = -ENOENT;
+
+	if (battery_ok) {
+		struct divider_data *ddp = &divider_data;
+		struct adc_sequence *sp = &ddp->adc_seq;
+
+		/* the driver keeps its own copy of the sequence */
+		rc = adc_read_async(ddp->adc, sp, done);
+		sp->calibrate = false;
+	}
+
+	return rc;
+}
+#endif /* CONFIG_ADC_ASYNC */
+
 unsigned int battery_level_pptt(unsigned int batt_mV,
 				const struct battery_level_point *curve)
 {
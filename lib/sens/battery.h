@@ -7,6 +7,8 @@
 #ifndef APPLICATION_BATTERY_H_
 #define APPLICATION_BATTERY_H_
 
+struct k_poll_signal;
+
 /** Enable or disable measurement of the battery voltage.
  *
  * @param enable true to enable, false to disable
@@ -22,6 +24,36 @@ int battery_measure_enable(bool enable);
  */
 int battery_sample(void);
 
+/** Start a battery voltage conversion without waiting for it.
+ *
+ * @param done signal raised with the conversion result when it
+ * completes.
+ *
+ * @return zero if the conversion was started, or a negative error
+ * code.
+ */
+int battery_sample_async(struct k_poll_signal *done);
+
+/** Convert the last completed conversion to a battery voltage.
+ *
+ * @return the battery voltage in millivolts.
+ */
+int battery_sample_result(void);
+
+/** Whether the battery measurement was set up at boot.
+ *
+ * @return true if battery_sample() and battery_sample_async() can
+ * measure, whether through a divider or directly at Vdd.
+ */
+bool battery_ready(void);
+
+/** Total resistance of the battery voltage divider.
+ *
+ * @return the divider resistance in ohms, or zero if the battery is
+ * measured directly at Vdd or measurement is unavailable.
+ */
+unsigned int battery_divider_ohm(void);
+
 /** A point in a battery discharge curve sequence.
  *
  * A discharge curve is defined as a sequence of these points, where
@@ -12,179 +12,176 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
-#include <zephyr/drivers/sensor/ccs811.h>
+#include <zephyr/pm/device.h>
 #include <stdio.h>
 #include <zephyr/sys/util.h>
-#include <math.h>
+#ifdef CONFIG_USE_SEGGER_RTT
+#include <SEGGER_RTT.h>
+#endif
 
 #include "sens.h"
+#include "sens_bus.h"
+#include "sens_hist.h"
+#include "sens_log.h"
+#include "sens_stats.h"
+#include "sens_fuel.h"
+#include "sens_backend.h"
+#include "sens_adapt.h"
+#include "sens_orient.h"
+#include "sens_filt.h"
+#include "perf.h"
 #include "battery.h"
 
 LOG_MODULE_REGISTER(climate_sens, CONFIG_LOG_DEFAULT_LEVEL);
 
-/** A discharge curve specific to the power source. */
-static const struct battery_level_point levels[] = {
-#if DT_NODE_HAS_PROP(DT_INST(0, voltage_divider), io_channels)
-	/* "Curve" here eyeballed from captured data for the [Adafruit
-	 * 3.7v 2000 mAh](https://www.adafruit.com/product/2011) LIPO
-	 * under full load that started with a charge of 3.96 V and
-	 * dropped about linearly to 3.58 V over 15 hours.  It then
-	 * dropped rapidly to 3.10 V over one hour, at which point it
-	 * stopped transmitting.
-	 *
-	 * Based on eyeball comparisons we'll say that 15/16 of life
-	 * goes between 3.95 and 3.55 V, and 1/16 goes between 3.55 V
-	 * and 3.1 V.
-	 */
-
-	{ 10000, 3950 },
-	{ 625, 3550 },
-	{ 0, 3100 },
-#else
-	/* Linear from maximum voltage to minimum voltage. */
-	{ 10000, 3600 },
-	{ 0, 1700 },
-#endif
-};
+/*
+ * Per-reading log lines, only built with CONFIG_APP_SENS_LOG_VERBOSE.
+ * Otherwise the sample path logs one rate limited summary per cycle.
+ */
+#define SENS_LOG_SAMPLE(...) do { \
+	if (IS_ENABLED(CONFIG_APP_SENS_LOG_VERBOSE)) { \
+		LOG_INF(__VA_ARGS__); \
+	} \
+} while (0)
 
-static bool app_fw_2;
+/* Cycles per summary line, 0 for none */
+static atomic_t trace_every = ATOMIC_INIT(CONFIG_APP_SENS_TRACE_EVERY);
+
+/* Where readings come from, see sens_backend.h */
+static const struct sens_backend *be;
 /* Global buffer to save fetched sample data */
-static struct sens_packet sens_data = {0};
-/* Define a sensor msgq */
-K_MSGQ_DEFINE(sens_q, sizeof(struct sens_packet), 20, 4);
+static struct sens_packet sens_data = { .version = SENS_PACKET_VERSION };
 
-/* Process and fetch HTS221 sample and update packet buffer*/
-static void hts221_process_sample(const struct device *dev)
+/* Condition a reading on its way into the packet */
+static inline int32_t sens_filt(enum sens_filt_chan chan, int32_t val)
+{
+#ifdef CONFIG_APP_SENS_FILT
+	return sens_filt_run(chan, val);
+#else
+	return val;
+#endif
+}
+
+#ifdef CONFIG_APP_SENS_HTS221
+/* Process HTS221 sample and update packet buffer*/
+static void hts221_process_sample(enum sens_src src, int rc)
 {
 #ifdef CONFIG_APP_OBS_NUMBER
 	static unsigned int obs;
 #endif
 	struct sensor_value temp, hum;
-	if (sensor_sample_fetch(dev) < 0) {
+	if (rc < 0) {
 		LOG_ERR("hts221: sensor sample update error\n");
 		return;
 	}
 
-	if (sensor_channel_get(dev, SENSOR_CHAN_AMBIENT_TEMP, &temp) < 0) {
+	if (be->channel_get(src, SENSOR_CHAN_AMBIENT_TEMP, &temp) < 0) {
 		LOG_ERR("hts221: cannot read HTS221 temperature channel\n");
 		return;
 	}
 
-	if (sensor_channel_get(dev, SENSOR_CHAN_HUMIDITY, &hum) < 0) {
+	if (be->channel_get(src, SENSOR_CHAN_HUMIDITY, &hum) < 0) {
 		LOG_ERR("hts221: cannot read HTS221 humidity channel\n");
 		return;
 	}
 
 #ifdef CONFIG_APP_OBS_NUMBER
 	++obs;
-	LOG_INF("hts221: observation:%u\n", obs);
+	SENS_LOG_SAMPLE("hts221: observation:%u\n", obs);
 #endif
 
+	/* Update data buffers */
+	sens_data.hts221_temp = sens_filt(SENS_FILT_TEMP, sens_value_to_fixed(&temp, 100));
+	sens_data.hts221_rh = sens_filt(SENS_FILT_RH, sens_value_to_fixed(&hum, 100));
+	sens_data.valid |= SENS_VALID_HTS221;
+
 	/* display temperature */
-	LOG_INF("hts221: temperature:%.1f C\n", sensor_value_to_double(&temp));
+	SENS_LOG_SAMPLE("hts221: temperature:%s%d.%02d C\n",
+		SENS_CENTI_ARGS(sens_data.hts221_temp));
 
 	/* display humidity */
-	LOG_INF("hts221: relative Humidity:%.1f%%\n",
-		sensor_value_to_double(&hum));
-
-	/* Update data buffers */
-	sens_data.hts221_temp = sensor_value_to_double(&temp);
-	sens_data.hts221_rh = sensor_value_to_double(&hum);
+	SENS_LOG_SAMPLE("hts221: relative Humidity:%s%d.%02d%%\n",
+		SENS_CENTI_ARGS(sens_data.hts221_rh));
 }
+#endif /* CONFIG_APP_SENS_HTS221 */
 
-/* process and fetch lps22hb sample and update packet buffer*/
-static void lps22hb_process_sample(const struct device *dev)
+#ifdef CONFIG_APP_SENS_LPS22HB
+/* process lps22hb sample and update packet buffer*/
+static void lps22hb_process_sample(enum sens_src src, int rc)
 {
 #ifdef CONFIG_APP_OBS_NUMBER
 	static unsigned int obs;
 #endif
 	struct sensor_value pressure, temp;
 
-	if (sensor_sample_fetch(dev) < 0) {
+	if (rc < 0) {
 		LOG_ERR("lps22hb: sensor sample update error\n");
 		return;
 	}
 
-	if (sensor_channel_get(dev, SENSOR_CHAN_PRESS, &pressure) < 0) {
+	if (be->channel_get(src, SENSOR_CHAN_PRESS, &pressure) < 0) {
 		LOG_ERR("lps22hb: cannot read LPS22HB pressure channel\n");
 		return;
 	}
 
-	if (sensor_channel_get(dev, SENSOR_CHAN_AMBIENT_TEMP, &temp) < 0) {
+	if (be->channel_get(src, SENSOR_CHAN_AMBIENT_TEMP, &temp) < 0) {
 		LOG_ERR("lps22hb: cannot read LPS22HB temperature channel\n");
 		return;
 	}
 
 #ifdef CONFIG_APP_OBS_NUMBER
 	++obs;
-	LOG_INF("lps22hb: observation:%u\n", obs);
+	SENS_LOG_SAMPLE("lps22hb: observation:%u\n", obs);
 #endif
 
+	/* Update data buffers, pressure comes in kPa */
+	sens_data.lps22hb_press = sens_filt(SENS_FILT_PRESS, sens_value_to_fixed(&pressure, 1000));
+	sens_data.lps22hb_temp = sens_filt(SENS_FILT_PTEMP, sens_value_to_fixed(&temp, 100));
+	sens_data.valid |= SENS_VALID_LPS22HB;
+
 	/* display pressure */
-	LOG_INF("lps22hb: pressure:%.1f kPa\n", sensor_value_to_double(&pressure));
+	SENS_LOG_SAMPLE("lps22hb: pressure:%u Pa\n", sens_data.lps22hb_press);
 
 	/* display temperature */
-	LOG_INF("lps22hb: temperature:%.1f C\n", sensor_value_to_double(&temp));
-
-	/* Update data buffers */
-	sens_data.lps22hb_press = sensor_value_to_double(&pressure);
-	sens_data.lps22hb_temp = sensor_value_to_double(&temp);
+	SENS_LOG_SAMPLE("lps22hb: temperature:%s%d.%02d C\n",
+		SENS_CENTI_ARGS(sens_data.lps22hb_temp));
 }
+#endif /* CONFIG_APP_SENS_LPS22HB */
 
-/* Process and fetch CCS811 sample and update packet buffer*/
-static int ccs811_process_sample(const struct device *dev)
+#ifdef CONFIG_APP_SENS_CCS811
+/* Process CCS811 sample and update packet buffer*/
+static void ccs811_process_sample(enum sens_src src, int rc)
 {
-	struct sensor_value co2, tvoc, voltage, current;
-	int rc = 0;
-#ifdef CONFIG_APP_MONITOR_BASELINE
-	int baseline = -1;
-	rc = ccs811_baseline_fetch(dev);
-	if (rc >= 0) {
-		baseline = rc;
-		rc = 0;
-	}
-#endif
-	if (rc == 0) {
-		rc = sensor_sample_fetch(dev);
-	}
-	if (rc == 0) {
-		const struct ccs811_result_type *rp = ccs811_result(dev);
+	struct sensor_value co2, tvoc;
 
-		sensor_channel_get(dev, SENSOR_CHAN_CO2, &co2);
-		sensor_channel_get(dev, SENSOR_CHAN_VOC, &tvoc);
-		sensor_channel_get(dev, SENSOR_CHAN_VOLTAGE, &voltage);
-		sensor_channel_get(dev, SENSOR_CHAN_CURRENT, &current);
-		LOG_INF("ccs811: %u ppm eCO2; %u ppb eTVOC\n",
+	if (rc == 0) {
+		be->channel_get(src, SENSOR_CHAN_CO2, &co2);
+		be->channel_get(src, SENSOR_CHAN_VOC, &tvoc);
+		SENS_LOG_SAMPLE("ccs811: %u ppm eCO2; %u ppb eTVOC\n",
 		       co2.val1, tvoc.val1);
 		/* Update data buffers */
-		sens_data.ccs811_eco2 = co2.val1;
-		sens_data.ccs811_etvoc = tvoc.val1;
-#ifdef CONFIG_CCS811_VERBOSE
-		LOG_INF("ccs811: Voltage: %d.%06dV; Current: %d.%06dA\n", voltage.val1,
-		       voltage.val2, current.val1, current.val2);
-#endif
-#ifdef CONFIG_APP_MONITOR_BASELINE
-		LOG_INF("ccs811: baseline %04x\n", baseline);
-#endif
-		if (app_fw_2 && !(rp->status & CCS811_STATUS_DATA_READY)) {
-			LOG_ERR("ccs811: stale data\n");
-		}
-
-		if (rp->status & CCS811_STATUS_ERROR) {
-			LOG_ERR("ccs811: status error: %02x\n", rp->error);
-		}
+		sens_data.ccs811_eco2 = sens_filt(SENS_FILT_ECO2, co2.val1);
+		sens_data.ccs811_etvoc = sens_filt(SENS_FILT_TVOC, tvoc.val1);
+		sens_data.valid |= SENS_VALID_CCS811;
+	} else if (rc == -EAGAIN) {
+		LOG_WRN("CCS811 fetch got stale data\n");
+	} else {
+		LOG_ERR("CCS811 fetch failed: %d\n", rc);
 	}
-	return rc;
 }
+#endif /* CONFIG_APP_SENS_CCS811 */
 
-/* Process and fetch lis2dh sample and update packet buffer*/
-static void lis2dh_process_sample(const struct device *sensor)
+#ifdef CONFIG_APP_SENS_LIS2DH
+/* Process lis2dh sample and update packet buffer, in FIFO mode the
+ * sample is the mean of the last batch
+ */
+static void lis2dh_process_sample(enum sens_src src, int rc)
 {
 	static unsigned int count;
 	struct sensor_value accel[3];
+	struct sens_orient orient;
 	const char *overrun = "";
-	double rads = 0, degs = 0;
-	int rc = sensor_sample_fetch(sensor);
+	int32_t x, y, z;
 
 	++count;
 	if (rc == -EBADMSG) {
@@ -195,121 +192,691 @@ static void lis2dh_process_sample(const struct device *sensor)
 		rc = 0;
 	}
 	if (rc == 0) {
-		rc = sensor_channel_get(sensor,
-					SENSOR_CHAN_ACCEL_XYZ,
-					accel);
+		rc = be->channel_get(src, SENSOR_CHAN_ACCEL_XYZ, accel);
 	}
 	if (rc < 0) {
 		LOG_ERR("ERROR: Update failed: %d\n", rc);
 	} else {
-		LOG_INF("lisdh: #%u @ %u ms: %sx %f , y %f , z %f",
-		       count, k_uptime_get_32(), overrun,
-		       sensor_value_to_double(&accel[0]),
-		       sensor_value_to_double(&accel[1]),
-		       sensor_value_to_double(&accel[2]));
-		rads = atan(sensor_value_to_double(&accel[0])/(sensor_value_to_double(&accel[1])));
-		degs = rads*RAD_TO_DEG;
-		sens_data.xy_angle = rads*RAD_TO_DEG;
-		LOG_INF("lisdh: angle: %.2f", degs);
+		x = sens_value_to_fixed(&accel[0], 100);
+		y = sens_value_to_fixed(&accel[1], 100);
+		z = sens_value_to_fixed(&accel[2], 100);
+		SENS_LOG_SAMPLE("lisdh: #%u @ %u ms: %sx %s%d.%02d , y %s%d.%02d , z %s%d.%02d",
+		       count, be->time_ms(), overrun,
+		       SENS_CENTI_ARGS(x), SENS_CENTI_ARGS(y), SENS_CENTI_ARGS(z));
+		sens_orient_update(x, y, z);
+		sens_orient_get(&orient);
+		sens_data.xy_angle = orient.xy;
+		sens_data.valid |= SENS_VALID_LIS2DH;
+		SENS_LOG_SAMPLE("lisdh: angle: %s%d.%02d pitch %s%d.%02d roll %s%d.%02d",
+		       SENS_CENTI_ARGS(orient.xy), SENS_CENTI_ARGS(orient.pitch),
+		       SENS_CENTI_ARGS(orient.roll));
 	}
 }
+#endif /* CONFIG_APP_SENS_LIS2DH */
 
-/* Process and fetch vBATT sample and update packet buffer*/
-void battery_process_sample(void) {
- 	int batt_mV;
-	unsigned int batt_pptt;
+#ifdef CONFIG_APP_SENS_BATT
+/* Process vBATT sample through the fuel gauge and update packet buffer */
+static void battery_process_sample(enum sens_src src, int batt_mV)
+{
+	struct sens_fuel_state fuel;
 
-	batt_mV = battery_sample();
-	batt_pptt = battery_level_pptt(batt_mV, levels);
-	LOG_INF("%d mV; %u pptt\n",
-		batt_mV, batt_pptt);
+	ARG_UNUSED(src);
+	if (batt_mV < 0) {
+		LOG_ERR("battery: sample failed: %d\n", batt_mV);
+		return;
+	}
+	sens_fuel_update(batt_mV, be->time_ms());
+	sens_fuel_get(&fuel);
+	SENS_LOG_SAMPLE("%d mV; filtered %u mV; %u pptt\n",
+		batt_mV, fuel.mV, fuel.pptt);
+
+	sens_data.batt_mV = fuel.mV;
+	sens_data.batt_pptt = fuel.pptt;
+	sens_data.batt_tte_min = fuel.tte_min;
+	sens_data.valid |= SENS_VALID_BATT;
+}
+#endif /* CONFIG_APP_SENS_BATT */
 
-	sens_data.batt_mV = batt_mV;
+/* Acquisition source, the backend fetch does the transaction and process
+ * consumes it. dev is the backend device, only used for device PM.
+ */
+struct sens_source {
+	const char *name;
+	const struct device *dev;
+	void (*process)(enum sens_src src, int rc);
+	int rc;
+	uint32_t fetch_us;
+	uint32_t period_ms;
+	int64_t next_ms;        //absolute deadline of the next sample
+	uint32_t missed;        //deadlines missed since boot
+	uint32_t on_nA;         //supply current while running, for the estimate
+	uint32_t off_nA;        //supply current when suspended
+	uint16_t wake_ms;       //resume to first valid sample
+#ifdef CONFIG_APP_SENS_ASYNC
+	struct k_work work;
+#endif
+};
+
+/*
+ * Typical datasheet supply currents used by the charge estimate, nA. They
+ * are a model to compare configurations with, not a measurement.
+ */
+#define SOC_IDLE_NA     3000        //System ON idle, RTC running, RAM retained
+#define SOC_RUN_NA      4000000     //CPU and TWIM busy during the fetch phase
+
+#if defined(CONFIG_CCS811_DRIVE_MODE_0)
+#define CCS811_ON_NA    19000       //idle, no measurements
+#elif defined(CONFIG_CCS811_DRIVE_MODE_2)
+#define CCS811_ON_NA    1150000     //heater pulsed every 10 s
+#elif defined(CONFIG_CCS811_DRIVE_MODE_3)
+#define CCS811_ON_NA    360000      //heater pulsed every 60 s
+#else
+#define CCS811_ON_NA    14000000    //constant heater power
+#endif
+
+/* Process function of a source, NULL when it is not built in */
+#define SENS_PROC(_cfg, _fn) COND_CODE_1(_cfg, (_fn), (NULL))
+
+static struct sens_source sources[SENS_SRC_COUNT] = {
+	[SENS_SRC_HTS221] = { "hts221", NULL,
+			      SENS_PROC(CONFIG_APP_SENS_HTS221, hts221_process_sample),
+			      .period_ms = CONFIG_APP_SENS_PERIOD_HTS221_MS,
+			      .on_nA = 2000, .off_nA = 500 },
+	[SENS_SRC_LPS22HB] = { "lps22hb", NULL,
+			       SENS_PROC(CONFIG_APP_SENS_LPS22HB, lps22hb_process_sample),
+			       .period_ms = CONFIG_APP_SENS_PERIOD_LPS22HB_MS,
+			       .on_nA = 12000, .off_nA = 1000 },
+	/* one sample period at 100 Hz plus turn-on */
+	[SENS_SRC_LIS2DH] = { "lis2dh", NULL,
+			      SENS_PROC(CONFIG_APP_SENS_LIS2DH, lis2dh_process_sample),
+			      .period_ms = CONFIG_APP_SENS_PERIOD_LIS2DH_MS,
+			      .on_nA = 10000, .off_nA = 500, .wake_ms = 20 },
+	/* divider current is modelled from the measured voltage instead */
+	[SENS_SRC_BATT] = { "battery", NULL,
+			    SENS_PROC(CONFIG_APP_SENS_BATT, battery_process_sample),
+			    .period_ms = CONFIG_APP_SENS_PERIOD_BATT_MS },
+	[SENS_SRC_CCS811] = { "ccs811", NULL,
+			      SENS_PROC(CONFIG_APP_SENS_CCS811, ccs811_process_sample),
+			      .period_ms = CONFIG_APP_SENS_PERIOD_CCS811_MS,
+			      .on_nA = CCS811_ON_NA, .off_nA = 19000 },
+};
+
+/* Sources built in and found by the backend, the only ones sampled */
+static uint32_t sens_srcs;
+/* Deadlines and periods, also moved by sens_sched_period_set */
+static struct k_spinlock sched_lock;
+/* Given by a kick, kept until the thread waits so none is lost */
+K_SEM_DEFINE(sched_kick, 0, 1);
+/* Sources fetched on data-ready instead of by period */
+static uint32_t sched_triggered;
+
+static struct sens_acq_stats acq_stats;
+static struct sens_power_stats pwr_stats;
+static struct k_spinlock acq_lock;
+/* Sources put in device PM suspend between their reads */
+static uint32_t pm_suspended;
+
+const char *sens_src_name(enum sens_src src)
+{
+	return (src < SENS_SRC_COUNT) ? sources[src].name : "?";
+}
+
+bool sens_src_present(enum sens_src src)
+{
+	return (src < SENS_SRC_COUNT) && (sens_srcs & BIT(src));
 }
 
 /*
- * Sensor thread to read out all sensory data collected
- * by the onboard climate sensors. Once fetched, send data to consumer
- * threads (display thread etc...)
+ * Move a source to a new period keeping its phase, the next deadline is
+ * the last one plus the new period, but never in the past. Called with
+ * sched_lock held.
  */
-void sens_thread(void *unused1, void *unused2, void *unused3)
+static void sens_sched_retime(struct sens_source *src, uint32_t period_ms,
+			      int64_t now)
 {
-	const struct device *hts221_dev = device_get_binding("HTS221");
-	const struct device *lps22hb_dev = device_get_binding(DT_LABEL(DT_INST(0, st_lps22hb_press)));
-	const struct device *ccs811_dev = device_get_binding(DT_LABEL(DT_INST(0, ams_ccs811)));
-	const struct device *lis2dh_dev = DEVICE_DT_GET_ANY(st_lis2dh);
-	struct ccs811_configver_type cfgver;
-	int rc;
+	src->next_ms = MAX(src->next_ms - src->period_ms + period_ms, now);
+	src->period_ms = period_ms;
+}
+
+int sens_sched_period_set(enum sens_src src, uint32_t period_ms)
+{
+	k_spinlock_key_t key;
 
-	/* HW INIT/OK */
-	if (battery_measure_enable(true) != 0) {
-		LOG_ERR("failed to setup battery meas");
+	if (src >= SENS_SRC_COUNT || period_ms < SENS_PERIOD_MIN_MS) {
+		return -EINVAL;
 	}
+	key = k_spin_lock(&sched_lock);
+	sens_sched_retime(&sources[src], period_ms, k_uptime_get());
+	k_spin_unlock(&sched_lock, key);
+	/* Wake the scheduler so the timer is rearmed on the new deadline */
+	sens_sched_kick();
+	return 0;
+}
 
-	if (lis2dh_dev == NULL) {
-		LOG_ERR("could not get LIS2DH device\n");
-		return;
+void sens_sched_kick(void)
+{
+	k_sem_give(&sched_kick);
+}
+
+uint32_t sens_sched_period_get(enum sens_src src)
+{
+	return (src < SENS_SRC_COUNT) ? sources[src].period_ms : 0;
+}
+
+uint32_t sens_sched_missed_get(enum sens_src src)
+{
+	return (src < SENS_SRC_COUNT) ? sources[src].missed : 0;
+}
+
+void sens_acq_stats_get(struct sens_acq_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&acq_lock);
+
+	*stats = acq_stats;
+	k_spin_unlock(&acq_lock, key);
+}
+
+void sens_power_stats_get(struct sens_power_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&acq_lock);
+
+	*stats = pwr_stats;
+	k_spin_unlock(&acq_lock, key);
+}
+
+#ifdef CONFIG_APP_SENS_LOW_POWER
+/* Suspend every sensor whose driver supports device PM, the rest keep
+ * running in their configured continuous mode. Data-ready sources are
+ * never resumed by a deadline, they stay running to raise their interrupt.
+ */
+static void sens_pm_init(void)
+{
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		int rc;
+
+		if (sources[i].dev == NULL) {
+			continue;
+		}
+		if (sched_triggered & BIT(i)) {
+			LOG_INF("%s: data-ready, left running", sources[i].name);
+			continue;
+		}
+		rc = pm_device_action_run(sources[i].dev, PM_DEVICE_ACTION_SUSPEND);
+		if (rc == 0 || rc == -EALREADY) {
+			pm_suspended |= BIT(i);
+		} else {
+			LOG_INF("%s: no device PM (%d), left running",
+				sources[i].name, rc);
+		}
 	}
+}
 
-	if (!device_is_ready(lis2dh_dev)) {
-		LOG_ERR("lis2dh: device is not ready\n");
-		return;
+/* Resume or suspend the suspendable sources in mask. Returns the longest
+ * wake time of the sources resumed.
+ */
+static uint16_t sens_pm_set(uint32_t mask, bool on)
+{
+	uint16_t wake_ms = 0;
+
+	mask &= pm_suspended;
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		int rc;
+
+		if (!(mask & BIT(i))) {
+			continue;
+		}
+		rc = pm_device_action_run(sources[i].dev, on ?
+					  PM_DEVICE_ACTION_RESUME :
+					  PM_DEVICE_ACTION_SUSPEND);
+		if (rc != 0 && rc != -EALREADY) {
+			LOG_WRN("%s: pm %s failed: %d", sources[i].name,
+				on ? "resume" : "suspend", rc);
+		}
+		wake_ms = MAX(wake_ms, sources[i].wake_ms);
 	}
+	return wake_ms;
+}
+#else
+static void sens_pm_init(void)
+{
+}
 
-	if (hts221_dev == NULL) {
-		LOG_ERR("could not get HTS221 device\n");
-		return;
+static uint16_t sens_pm_set(uint32_t mask, bool on)
+{
+	ARG_UNUSED(mask);
+	ARG_UNUSED(on);
+	return 0;
+}
+#endif /* CONFIG_APP_SENS_LOW_POWER */
+
+/*
+ * Charge model for the interval since the previous cycle: SoC idle plus
+ * the fetch phase at run current, every sensor at its running or suspended
+ * current, suspended ones running for their wake time and fetch, and the
+ * battery divider either fed throughout or only while it is read.
+ * Currents in nA times times in us gives fC.
+ */
+static void sens_power_update(uint32_t done, uint32_t cycle_us,
+			      uint16_t wake_ms)
+{
+	static int64_t last_ms;
+	int64_t now = k_uptime_get();
+	uint32_t dt_ms = last_ms ? (uint32_t)(now - last_ms) : 0;
+	uint64_t dt_us = (uint64_t)dt_ms * USEC_PER_MSEC;
+	unsigned int div_ohm = 0;
+	uint64_t fC;
+	k_spinlock_key_t key;
+
+#if defined(CONFIG_APP_SENS_BATT) && defined(CONFIG_APP_SENS_BACKEND_HW)
+	if (sens_srcs & BIT(SENS_SRC_BATT)) {
+		div_ohm = battery_divider_ohm();
 	}
+#endif
+	last_ms = now;
+	fC = SOC_IDLE_NA * dt_us + (uint64_t)(SOC_RUN_NA - SOC_IDLE_NA) * cycle_us;
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		const struct sens_source *src = &sources[i];
 
-	if (lps22hb_dev == NULL) {
-		LOG_ERR("could not get LPS22HB device\n");
-		return;
+		if (!(sens_srcs & BIT(i))) {
+			continue;
+		}
+		if (!(pm_suspended & BIT(i))) {
+			fC += src->on_nA * dt_us;
+			continue;
+		}
+		fC += src->off_nA * dt_us;
+		if (done & BIT(i)) {
+			fC += (uint64_t)(src->on_nA - src->off_nA) *
+			      (wake_ms * USEC_PER_MSEC + src->fetch_us);
+		}
+	}
+	if (div_ohm != 0) {
+		/* mV / ohm is mA */
+		uint64_t div_nA = (uint64_t)sens_data.batt_mV * 1000000U / div_ohm;
+
+		if (!IS_ENABLED(CONFIG_APP_SENS_LOW_POWER)) {
+			fC += div_nA * dt_us;
+		} else if (done & BIT(SENS_SRC_BATT)) {
+			/* fed from the start of the cycle to the end of its read */
+			fC += div_nA * cycle_us;
+		}
 	}
 
-	if (ccs811_dev == NULL) {
-		LOG_ERR("could not get CCS811 device\n");
-		return;
+	key = k_spin_lock(&acq_lock);
+	pwr_stats.cycle_nC = fC / 1000000U;
+	pwr_stats.interval_ms = dt_ms;
+	pwr_stats.avg_uA = dt_ms ? pwr_stats.cycle_nC / dt_ms : 0;
+	pwr_stats.total_nC += pwr_stats.cycle_nC;
+	pwr_stats.suspended = pm_suspended;
+	k_spin_unlock(&acq_lock, key);
+
+	LOG_DBG("power: %u nC over %u ms, %u uA", pwr_stats.cycle_nC, dt_ms,
+		pwr_stats.avg_uA);
+}
+
+/* Run one fetch and time it */
+static void sens_source_fetch(struct sens_source *src)
+{
+	uint32_t start = k_cycle_get_32();
+
+	src->rc = be->fetch(src - sources);
+	src->fetch_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+}
+
+#ifdef CONFIG_APP_SENS_ASYNC
+/*
+ * Each source is fetched on its own worker queue so that blocking I2C/ADC
+ * transactions overlap. Devices sharing a bus are still serialised by the
+ * bus driver, but the wait for conversions and the ADC run concurrently.
+ */
+static struct k_work_q acq_wq[CONFIG_APP_SENS_ASYNC_WORKERS];
+K_THREAD_STACK_ARRAY_DEFINE(acq_wq_stack, CONFIG_APP_SENS_ASYNC_WORKERS,
+			    CONFIG_APP_SENS_ASYNC_STACK_SIZE);
+K_EVENT_DEFINE(acq_done);
+
+static void sens_fetch_work(struct k_work *work)
+{
+	struct sens_source *src = CONTAINER_OF(work, struct sens_source, work);
+
+	sens_source_fetch(src);
+	k_event_post(&acq_done, BIT(src - sources));
+}
+
+static void sens_acq_init(void)
+{
+	for (int i = 0; i < CONFIG_APP_SENS_ASYNC_WORKERS; i++) {
+		struct k_work_queue_config cfg = { .name = "sens_acq" };
+
+		k_work_queue_start(&acq_wq[i], acq_wq_stack[i],
+				   K_THREAD_STACK_SIZEOF(acq_wq_stack[i]),
+				   SENS_T_PRIOR, &cfg);
+	}
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		k_work_init(&sources[i].work, sens_fetch_work);
 	}
+}
 
-	rc = ccs811_configver_fetch(ccs811_dev, &cfgver);
+/* Submit every due fetch up front, then gather completions.
+ * Returns the mask of sources whose fetch completed this cycle.
+ */
+static uint32_t sens_acq_run(uint32_t mask)
+{
+	uint32_t pending = 0;
 
-	if (rc == 0) {
-		LOG_INF("ccs811: HW %02x; FW Boot %04x App %04x ; mode %02x\n",
-		       cfgver.hw_version, cfgver.fw_boot_version,
-		       cfgver.fw_app_version, cfgver.mode);
-		app_fw_2 = (cfgver.fw_app_version >> 8) > 0x11;
+	k_event_set(&acq_done, 0);
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (!(mask & BIT(i))) {
+			continue;
+		}
+		/* A fetch still stuck from an earlier cycle is skipped */
+		if (k_work_busy_get(&sources[i].work) != 0) {
+			LOG_WRN("%s: fetch still in flight, skipped", sources[i].name);
+			continue;
+		}
+		k_work_submit_to_queue(&acq_wq[i % CONFIG_APP_SENS_ASYNC_WORKERS],
+				       &sources[i].work);
+		pending |= BIT(i);
 	}
 
-#ifdef CONFIG_APP_USE_DEF_ENVDATA
-	struct sensor_value temp = { CONFIG_APP_ENV_TEMPERATURE };
-	struct sensor_value humidity = { CONFIG_APP_ENV_HUMIDITY };
+	return k_event_wait_all(&acq_done, pending, false,
+				K_MSEC(CONFIG_APP_SENS_ASYNC_TIMEOUT_MS)) & pending;
+}
+#else
+static void sens_acq_init(void)
+{
+}
 
-	rc = ccs811_envdata_update(ccs811_dev, &temp, &humidity);
+/* Fetch every due source in turn */
+static uint32_t sens_acq_run(uint32_t mask)
+{
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (mask & BIT(i)) {
+			sens_source_fetch(&sources[i]);
+		}
+	}
+	return mask;
+}
+#endif /* CONFIG_APP_SENS_ASYNC */
 
-	LOG_INF("CCS811 Calibrated for %d Cel, %d %%RH Status %s : errno %d\n",
-			temp.val1, humidity.val1, rc ? "Calibration err" : "Okay", rc);
+void sens_trace_set(uint32_t every)
+{
+	atomic_set(&trace_every, every);
+}
+
+uint32_t sens_trace_get(void)
+{
+	return atomic_get(&trace_every);
+}
+
+/* One line for the whole packet, integer arguments only so deferred
+ * logging just copies them and formats later in the log thread.
+ */
+static void sens_trace_cycle(void)
+{
+	static uint32_t count;
+	uint32_t every = atomic_get(&trace_every);
+
+	if (every == 0 || ++count < every) {
+		return;
+	}
+	count = 0;
+	LOG_INF("T %d RH %u P %u T2 %d A %d CO2 %u VOC %u mV %u v %02x",
+		sens_data.hts221_temp, sens_data.hts221_rh, sens_data.lps22hb_press,
+		sens_data.lps22hb_temp, sens_data.xy_angle, sens_data.ccs811_eco2,
+		sens_data.ccs811_etvoc, sens_data.batt_mV, sens_data.valid);
+}
+
+/*
+ * Bytes written to the RTT console, up channel 0, since the last call.
+ * Telemetry on RTT has its own channel and is counted by 'sens telem'.
+ * Taken from the write offset modulo the buffer size, so an interval
+ * that writes a full buffer or more is undercounted by whole buffers.
+ */
+static uint32_t sens_rtt_bytes(void)
+{
+#ifdef CONFIG_USE_SEGGER_RTT
+	static unsigned int last;
+	unsigned int wr = _SEGGER_RTT.aUp[0].WrOff;
+	unsigned int size = _SEGGER_RTT.aUp[0].SizeOfBuffer;
+	uint32_t n = (wr + size - last) % size;
+
+	last = wr;
+	return n;
+#else
+	return 0;
 #endif
+}
+
+/* Fetch the due sources, account the timing, then process what completed */
+static void sens_acq_cycle(uint32_t mask)
+{
+	uint16_t wake_ms = sens_pm_set(mask, true);
+	uint32_t start, done, elapsed, proc_cyc;
+	uint32_t serial = 0;
+	k_spinlock_key_t key;
+	PERF_START(cycle_t0);
+
+	/* Let resumed sensors produce a sample, the SoC idles meanwhile */
+	if (wake_ms) {
+		k_msleep(wake_ms);
+	}
+	start = k_cycle_get_32();
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if ((mask & BIT(i)) && be->start) {
+			be->start(i);
+		}
+	}
+	done = sens_acq_run(mask);
+	elapsed = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+	/* A fetch still in flight keeps its device awake */
+	sens_pm_set(done, false);
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (done & BIT(i)) {
+			serial += sources[i].fetch_us;
+		}
+	}
+
+	key = k_spin_lock(&acq_lock);
+	acq_stats.start_cyc = start;
+	acq_stats.cycles++;
+	acq_stats.last_us = elapsed;
+	acq_stats.max_us = MAX(acq_stats.max_us, elapsed);
+	acq_stats.serial_us = serial;
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		acq_stats.fetch_us[i] = (done & BIT(i)) ? sources[i].fetch_us : 0;
+	}
+	k_spin_unlock(&acq_lock, key);
+
+	LOG_DBG("acq: cycle %u us, serial sum %u us", elapsed, serial);
+	sens_power_update(done, elapsed, wake_ms);
+
+	/* Processing and its logging are what the log settings change */
+	start = k_cycle_get_32();
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (done & BIT(i)) {
+			PERF_START(t0);
+
+			sources[i].process(i, sources[i].rc);
+			PERF_STOP(PERF_PROC(i), t0);
+		} else if (mask & BIT(i)) {
+			LOG_WRN("%s: fetch timed out", sources[i].name);
+		}
+	}
+	sens_trace_cycle();
+	proc_cyc = k_cycle_get_32() - start;
+
+	key = k_spin_lock(&acq_lock);
+	acq_stats.process_cyc = proc_cyc;
+	acq_stats.rtt_bytes = sens_rtt_bytes();
+	k_spin_unlock(&acq_lock, key);
+	PERF_STOP(PERF_SENS_CYCLE, cycle_t0);
+}
+
+/*
+ * Collect the sources due at now and advance their deadlines by whole
+ * periods, so each source stays phase-locked to its first deadline no
+ * matter how long a cycle takes. Periods skipped over count as missed.
+ */
+static uint32_t sens_sched_due(int64_t now)
+{
+	uint32_t late[SENS_SRC_COUNT] = { 0 };
+	k_spinlock_key_t key = k_spin_lock(&sched_lock);
+	uint32_t due = 0;
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		struct sens_source *src = &sources[i];
+
+		if (!(sens_srcs & BIT(i)) || (sched_triggered & BIT(i))) {
+			continue;
+		}
+		if (now < src->next_ms) {
+			continue;
+		}
+		due |= BIT(i);
+		src->next_ms += src->period_ms;
+		if (now >= src->next_ms) {
+			late[i] = (now - src->next_ms) / src->period_ms + 1;
+			src->missed += late[i];
+			src->next_ms += (int64_t)late[i] * src->period_ms;
+		}
+	}
+	k_spin_unlock(&sched_lock, key);
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (late[i]) {
+			LOG_WRN("%s: missed %u deadline(s)", sources[i].name, late[i]);
+		}
+	}
+	return due;
+}
+
+#ifdef CONFIG_APP_SENS_ADAPT
+/* Let the adaptive controller move the periods of the sources just sampled */
+static void sens_sched_adapt(int64_t now)
+{
+	uint32_t period[SENS_SRC_COUNT];
+	uint32_t changed;
+	k_spinlock_key_t key;
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		period[i] = sources[i].period_ms;
+	}
+	changed = sens_adapt_update(&sens_data, period);
+	key = k_spin_lock(&sched_lock);
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (!(changed & BIT(i)) || (sched_triggered & BIT(i))) {
+			continue;
+		}
+		sens_sched_retime(&sources[i], period[i], now);
+	}
+	k_spin_unlock(&sched_lock, key);
+}
+#endif /* CONFIG_APP_SENS_ADAPT */
+
+/*
+ * Earliest absolute deadline over the sources scheduled by period,
+ * INT64_MAX when every source is data-ready triggered.
+ */
+static int64_t sens_sched_next(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&sched_lock);
+	int64_t next = INT64_MAX;
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if ((sens_srcs & BIT(i)) && !(sched_triggered & BIT(i))) {
+			next = MIN(next, sources[i].next_ms);
+		}
+	}
+	k_spin_unlock(&sched_lock, key);
+	return next;
+}
+
+/*
+ * Sensor thread to read out all sensory data collected
+ * by the onboard climate sensors. Once fetched, send data to consumer
+ * threads (display thread etc...)
+ */
+void sens_thread(void *unused1, void *unused2, void *unused3)
+{
+	int64_t next;
+	uint32_t due;
+
+	be = sens_backend_get();
+	if (be->init() != 0) {
+		LOG_ERR("%s backend init failed\n", be->name);
+		return;
+	}
+	/* A sensor missing on this board is left out, the rest still run */
+	sens_srcs = SENS_SRC_ENABLED &
+		    (be->present ? be->present() : BIT_MASK(SENS_SRC_COUNT));
+	if (sens_srcs == 0) {
+		LOG_ERR("%s backend: no sources to sample\n", be->name);
+		return;
+	}
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		sources[i].dev = be->device(i);
+	}
+	if (be->paced && be->triggered) {
+		sched_triggered = be->triggered();
+	}
+	sens_acq_init();
+	sens_pm_init();
+
+	/* Every source is due on the first pass */
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		sources[i].next_ms = k_uptime_get();
+	}
 
 	while(1) {
-		/* Fetch, process and update */
-		hts221_process_sample(hts221_dev);
-		lps22hb_process_sample(lps22hb_dev);
-		lis2dh_process_sample(lis2dh_dev);
-		battery_process_sample();
-
-		rc = ccs811_process_sample(ccs811_dev);
-		if (rc == -EAGAIN) {
-			LOG_WRN("CCS811 fetch got stale data\n");
-		} else if (rc != 0) {
-			LOG_ERR("CCS811 fetch failed: %d\n", rc);
+		/* An unpaced backend samples every source back to back */
+		due = be->paced ? sens_sched_due(k_uptime_get()) : sens_srcs;
+		/* Data-ready sources, each read once per new result */
+		if (be->ready) {
+			due |= be->ready() & sched_triggered & sens_srcs;
+		}
+
+		if (due && be->cycle_begin && be->cycle_begin() != 0) {
+			LOG_INF("%s backend has no more samples", be->name);
+			return;
 		}
-		/* Collection complete (buffer update),now send data over */
-		if (k_msgq_put(&sens_q, &sens_data, K_NO_WAIT) != 0) {
-			/* Queue is full, lets purge it */
-			LOG_WRN("sensor data queue attempted overflow -> purged");
-			k_msgq_purge(&sens_q);
+		if (due) {
+			uint32_t now;
+
+			/* Fetch, process and update */
+			sens_data.valid = 0;
+			sens_acq_cycle(due);
+#ifdef CONFIG_APP_SENS_ADAPT
+			if (be->paced) {
+				sens_sched_adapt(k_uptime_get());
+			}
+#endif
+			now = be->time_ms();
+			/* Collection complete (buffer update),now send data over */
+			sens_bus_publish(&sens_data);
+#ifdef CONFIG_APP_SENS_HIST
+			sens_hist_append(&sens_data, now);
+#endif
+#ifdef CONFIG_APP_SENS_STATS
+			sens_stats_update(&sens_data, now);
+#endif
+#ifdef CONFIG_APP_SENS_LOG
+			sens_log_append(&sens_data, now);
+#endif
+		}
+		if (!be->paced) {
+			/* one tick, lower priority consumers still get to run */
+			k_sleep(K_TICKS(1));
+			continue;
 		}
-		//memset(&sens_data, 0, sizeof(struct sens_packet));
-		k_msleep(SAMPLE_UPDATE_RATE);
+		/*
+		 * Sleep until the next deadline, a runtime period change or
+		 * data-ready. With no periodic source only a kick wakes it,
+		 * K_TIMEOUT_ABS_MS(INT64_MAX) would overflow.
+		 */
+		next = sens_sched_next();
+		k_sem_take(&sched_kick, (next == INT64_MAX) ? K_FOREVER :
+			   K_TIMEOUT_ABS_MS(next));
 	}
-}
\ No newline at end of file
+}
@@ -9,32 +9,108 @@
 #ifndef SENS_H
 #define SENS_H
 
+#include <zephyr/sys/util.h>
+#include <zephyr/drivers/sensor.h>
+
 /* Sensor Thread Details */
-#define SENS_T_STACK_SIZE 2048
+#define SENS_T_STACK_SIZE CONFIG_APP_SENS_STACK_SIZE
 #define SENS_T_PRIOR 4
-#define SAMPLE_UPDATE_RATE 1000 //ms
+#define SENS_PERIOD_MIN_MS 10    //shortest per-source sample period
 
 #define RAD_TO_DEG 57.2958
 
+/* Acquisition sources, one per device sampled by sens_thread */
+enum sens_src {
+    SENS_SRC_HTS221,
+    SENS_SRC_LPS22HB,
+    SENS_SRC_LIS2DH,
+    SENS_SRC_BATT,
+    SENS_SRC_CCS811,
+    SENS_SRC_COUNT,
+};
+
+/* Sources built in, see the APP_SENS_<device> options */
+#define SENS_SRC_ENABLED ( \
+    (IS_ENABLED(CONFIG_APP_SENS_HTS221) ? BIT(SENS_SRC_HTS221) : 0) | \
+    (IS_ENABLED(CONFIG_APP_SENS_LPS22HB) ? BIT(SENS_SRC_LPS22HB) : 0) | \
+    (IS_ENABLED(CONFIG_APP_SENS_LIS2DH) ? BIT(SENS_SRC_LIS2DH) : 0) | \
+    (IS_ENABLED(CONFIG_APP_SENS_BATT) ? BIT(SENS_SRC_BATT) : 0) | \
+    (IS_ENABLED(CONFIG_APP_SENS_CCS811) ? BIT(SENS_SRC_CCS811) : 0))
+
+/* Acquisition timing, all times in us */
+struct sens_acq_stats {
+    uint32_t cycles;                    //completed sample cycles
+    uint32_t last_us;                   //fetch phase of the last cycle
+    uint32_t max_us;                    //worst fetch phase seen
+    uint32_t serial_us;                 //sum of the per-source fetch times
+    uint32_t fetch_us[SENS_SRC_COUNT];  //per-source fetch time, last cycle
+    uint32_t process_cyc;               //CPU cycles to process and log, last cycle
+    uint32_t rtt_bytes;                 //RTT console bytes over the last interval
+    uint32_t start_cyc;                 //cycle counter at the last cycle start
+};
+
+/* Modelled charge drawn by the sensor subsystem, display not included */
+struct sens_power_stats {
+    uint32_t cycle_nC;                  //charge over the last cycle interval
+    uint32_t interval_ms;               //length of that interval
+    uint32_t avg_uA;                    //mean current over the interval
+    uint64_t total_nC;                  //since the first cycle
+    uint32_t suspended;                 //sources suspended between reads
+};
+
 extern struct k_thread sens_t_data;
 extern k_tid_t sens_tid;
-extern struct k_msgq sens_q;
 /* ---------------------- */
 
 /* Sensor Packet */
+#define SENS_PACKET_VERSION 2
+
+/* sens_packet.valid bits, set when the channel was updated this cycle */
+#define SENS_VALID_HTS221   BIT(0)
+#define SENS_VALID_LPS22HB  BIT(1)
+#define SENS_VALID_CCS811   BIT(2)
+#define SENS_VALID_LIS2DH   BIT(3)
+#define SENS_VALID_BATT     BIT(4)
+
+/* Fixed-point, fields ordered so the packed layout stays naturally aligned */
 struct sens_packet {
-    double hts221_temp;     //celsius
-    double hts221_rh;       //rh%
-    double lps22hb_press;   //kPA
-    double lps22hb_temp;    //celsius
-    uint32_t ccs811_eco2;   //ppm
-    uint32_t ccs811_etvoc;  //ppb
-    double xy_angle;        //angle in degrees
-    uint32_t batt_mV;       //battery mV
-};
+    uint32_t lps22hb_press; //Pa
+    int16_t hts221_temp;    //centi-celsius
+    uint16_t hts221_rh;     //centi-rh%
+    int16_t lps22hb_temp;   //centi-celsius
+    int16_t xy_angle;       //centi-degrees
+    uint16_t batt_mV;       //battery mV
+    uint16_t ccs811_eco2;   //ppm
+    uint16_t ccs811_etvoc;  //ppb
+    uint16_t batt_pptt;     //battery level, parts per ten thousand
+    uint16_t batt_tte_min;  //time to empty, SENS_FUEL_TTE_UNKNOWN if unknown
+    uint8_t version;        //SENS_PACKET_VERSION
+    uint8_t valid;          //SENS_VALID_* mask
+} __packed;
+
+/* Convert a sensor_value to integer units of 1/scale, scale must divide 10^6 */
+static inline int32_t sens_value_to_fixed(const struct sensor_value *val,
+                                          int32_t scale)
+{
+    return val->val1 * scale + val->val2 / (1000000 / scale);
+}
+
+/* Expand a fixed-point value of 1/div units into "%s%d.%0Nd" arguments */
+#define SENS_FIXED_ARGS(v, div) ((v) < 0 ? "-" : ""), \
+    (((v) < 0 ? -(v) : (v)) / (div)), (((v) < 0 ? -(v) : (v)) % (div))
+#define SENS_CENTI_ARGS(v) SENS_FIXED_ARGS(v, 100)
 
 /* Function Declarations */
 extern void sens_thread(void *, void *, void *);
+extern const char *sens_src_name(enum sens_src src);
+extern bool sens_src_present(enum sens_src src);
+extern void sens_acq_stats_get(struct sens_acq_stats *stats);
+extern void sens_power_stats_get(struct sens_power_stats *stats);
+extern int sens_sched_period_set(enum sens_src src, uint32_t period_ms);
+extern uint32_t sens_sched_period_get(enum sens_src src);
+extern uint32_t sens_sched_missed_get(enum sens_src src);
+extern void sens_trace_set(uint32_t every);
+extern uint32_t sens_trace_get(void);
 /* ---------------------- */
 
 #endif
\ No newline at end of file
@@ -0,0 +1,276 @@
+/**
+ * @file sens_accel.c
+ * @author Wilfred Mallawa
+ * @brief LIS2DH FIFO acquisition. The Zephyr v3.1 driver reads one sample
+ *        per fetch and has no FIFO support, so once it has configured the
+ *        part this module switches it to stream mode with a watermark on
+ *        INT1. Each watermark interrupt drains the FIFO with one burst
+ *        read (the output address wraps in FIFO mode) and the batch is
+ *        reduced in a single pass: mean vector for the tilt, and the
+ *        peak sample to sample jerk for knock and motion detection.
+ *        Without an interrupt line in the devicetree a timer drains at
+ *        the rate the watermark would fire.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/logging/log.h>
+
+#include "sens_accel.h"
+
+LOG_MODULE_REGISTER(sens_accel, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define ACCEL_NODE      DT_INST(0, st_lis2dh)
+
+/* LIS2DH registers */
+#define REG_CTRL1       0x20
+#define REG_CTRL3       0x22
+#define REG_CTRL4       0x23
+#define REG_CTRL5       0x24
+#define REG_OUT_X_L     0x28
+#define REG_FIFO_CTRL   0x2e
+#define REG_FIFO_SRC    0x2f
+#define REG_AUTOINC     0x80
+
+#define CTRL1_ODR_SHIFT 4
+#define CTRL3_I1_WTM    BIT(2)
+#define CTRL4_FS_SHIFT  4
+#define CTRL5_FIFO_EN   BIT(6)
+#define FIFO_MODE_STREAM (2 << 6)
+#define FIFO_SRC_OVRN   BIT(6)
+#define FIFO_SRC_FSS    0x1f
+#define FIFO_DEPTH      32
+
+#define ODR_HZ          CONFIG_APP_SENS_ACCEL_ODR_HZ
+#define WTM             CONFIG_APP_SENS_ACCEL_WTM
+
+/* CTRL_REG1 ODR field for the configured rate */
+#define ODR_CODE (ODR_HZ == 1 ? 1 : ODR_HZ == 10 ? 2 : ODR_HZ == 25 ? 3 : \
+		  ODR_HZ == 50 ? 4 : ODR_HZ == 100 ? 5 : ODR_HZ == 200 ? 6 : \
+		  ODR_HZ == 400 ? 7 : 0)
+BUILD_ASSERT(ODR_CODE != 0, "LIS2DH rates are 1, 10, 25, 50, 100, 200, 400 Hz");
+
+static const struct i2c_dt_spec bus = I2C_DT_SPEC_GET(ACCEL_NODE);
+static const struct gpio_dt_spec int1 = GPIO_DT_SPEC_GET_BY_IDX_OR(ACCEL_NODE,
+								   irq_gpios, 0, {0});
+static struct gpio_callback int1_cb;
+static struct k_work drain_work;
+static struct k_timer drain_timer;
+
+static struct k_spinlock lock;
+static struct sens_accel_stats st = { .odr_hz = ODR_HZ };
+static int32_t mean[3];             //mean of the last batch, raw
+static int16_t prev[3];             //last sample of the previous batch
+static uint16_t fs_g = 2;           //full scale in g
+static uint16_t activity_mg;        //peak jerk since the last activity read
+
+/* Counters outside accel_batch(), from the ISR and the work queue */
+static void stat_inc(uint32_t *ctr)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	(*ctr)++;
+	k_spin_unlock(&lock, key);
+}
+
+/* Raw, left justified 16 bit sample to mg */
+static inline int32_t raw_to_mg(int32_t raw)
+{
+	return raw * fs_g * 1000 / 32768;
+}
+
+/*
+ * One pass over a burst: sum for the mean, L1 distance between
+ * successive samples for the jerk.
+ */
+static void accel_batch(const uint8_t *buf, int n, bool ovrn)
+{
+	int32_t sum[3] = { 0 };
+	uint32_t peak = 0;
+	k_spinlock_key_t key;
+
+	/* Only this work item writes samples, no lock to read it */
+	if (st.samples == 0) {
+		/* no jerk into the very first sample */
+		for (int a = 0; a < 3; a++) {
+			prev[a] = sys_get_le16(&buf[2 * a]);
+		}
+	}
+	for (int i = 0; i < n; i++, buf += 6) {
+		uint32_t jerk = 0;
+
+		for (int a = 0; a < 3; a++) {
+			int16_t v = sys_get_le16(&buf[2 * a]);
+
+			sum[a] += v;
+			jerk += abs(v - prev[a]);
+			prev[a] = v;
+		}
+		peak = MAX(peak, jerk);
+	}
+	peak = raw_to_mg(peak);
+
+	key = k_spin_lock(&lock);
+	for (int a = 0; a < 3; a++) {
+		mean[a] = sum[a] / n;
+	}
+	st.samples += n;
+	st.batches++;
+	st.overruns += ovrn;
+	st.peak_mg = MIN(peak, UINT16_MAX);
+	if (peak >= CONFIG_APP_SENS_ACCEL_KNOCK_MG) {
+		st.knocks++;
+	}
+	activity_mg = MAX(activity_mg, st.peak_mg);
+	k_spin_unlock(&lock, key);
+}
+
+/* Drain until the FIFO is below the watermark, so the edge fires again */
+static void accel_drain(struct k_work *work)
+{
+	uint8_t buf[FIFO_DEPTH * 6];
+	uint8_t src;
+	int n;
+
+	ARG_UNUSED(work);
+	for (int pass = 0; pass < 2; pass++) {
+		if (i2c_reg_read_byte_dt(&bus, REG_FIFO_SRC, &src) != 0) {
+			LOG_ERR("fifo status read failed");
+			return;
+		}
+		stat_inc(&st.i2c_xfers);
+		n = (src & FIFO_SRC_OVRN) ? FIFO_DEPTH : (src & FIFO_SRC_FSS);
+		if (n == 0) {
+			break;
+		}
+		if (i2c_burst_read_dt(&bus, REG_OUT_X_L | REG_AUTOINC, buf,
+				      n * 6) != 0) {
+			LOG_ERR("fifo read failed");
+			return;
+		}
+		stat_inc(&st.i2c_xfers);
+		accel_batch(buf, n, src & FIFO_SRC_OVRN);
+		if (n < WTM) {
+			break;
+		}
+	}
+}
+
+static void accel_int1(const struct device *port, struct gpio_callback *cb,
+		       uint32_t pins)
+{
+	stat_inc(&st.wakeups);
+	k_work_submit(&drain_work);
+}
+
+static void accel_tick(struct k_timer *timer)
+{
+	stat_inc(&st.wakeups);
+	k_work_submit(&drain_work);
+}
+
+/*
+ * Switch the driver configured part to FIFO stream mode at the
+ * configured rate. The full scale is left as the driver set it.
+ */
+int sens_accel_init(void)
+{
+	uint8_t ctrl4;
+	int rc;
+
+	if (!device_is_ready(bus.bus)) {
+		return -ENODEV;
+	}
+	k_work_init(&drain_work, accel_drain);
+
+	rc = i2c_reg_update_byte_dt(&bus, REG_CTRL1, 0xf0,
+				    ODR_CODE << CTRL1_ODR_SHIFT);
+	rc = rc ? rc : i2c_reg_read_byte_dt(&bus, REG_CTRL4, &ctrl4);
+	rc = rc ? rc : i2c_reg_write_byte_dt(&bus, REG_FIFO_CTRL, 0);
+	rc = rc ? rc : i2c_reg_update_byte_dt(&bus, REG_CTRL5, CTRL5_FIFO_EN,
+					      CTRL5_FIFO_EN);
+	rc = rc ? rc : i2c_reg_write_byte_dt(&bus, REG_FIFO_CTRL,
+					     FIFO_MODE_STREAM | WTM);
+	if (rc != 0) {
+		LOG_ERR("fifo setup failed: %d", rc);
+		return rc;
+	}
+	fs_g = 2 << ((ctrl4 >> CTRL4_FS_SHIFT) & 0x3);
+
+	if (int1.port != NULL && device_is_ready(int1.port)) {
+		rc = i2c_reg_write_byte_dt(&bus, REG_CTRL3, CTRL3_I1_WTM);
+		rc = rc ? rc : gpio_pin_configure_dt(&int1, GPIO_INPUT);
+		gpio_init_callback(&int1_cb, accel_int1, BIT(int1.pin));
+		rc = rc ? rc : gpio_add_callback(int1.port, &int1_cb);
+		rc = rc ? rc : gpio_pin_interrupt_configure_dt(&int1,
+							       GPIO_INT_EDGE_TO_ACTIVE);
+		if (rc == 0) {
+			LOG_INF("fifo: %u Hz, watermark %u, INT1", ODR_HZ, WTM);
+			/* drain whatever collected before the edge was armed */
+			k_work_submit(&drain_work);
+			return 0;
+		}
+		LOG_WRN("INT1 setup failed (%d), polling the fifo", rc);
+	}
+	k_timer_init(&drain_timer, accel_tick, NULL);
+	k_timer_start(&drain_timer, K_MSEC(WTM * MSEC_PER_SEC / ODR_HZ),
+		      K_MSEC(WTM * MSEC_PER_SEC / ODR_HZ));
+	LOG_INF("fifo: %u Hz, watermark %u, timer", ODR_HZ, WTM);
+	return 0;
+}
+
+/* Latest batch, no bus traffic. -EAGAIN until the first batch lands. */
+int sens_accel_fetch(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	int rc = st.batches ? 0 : -EAGAIN;
+
+	k_spin_unlock(&lock, key);
+	return rc;
+}
+
+/* Batch mean in m/s^2, as the driver reports a single sample */
+int sens_accel_channel_get(enum sensor_channel chan, struct sensor_value *val)
+{
+	k_spinlock_key_t key;
+
+	if (chan != SENSOR_CHAN_ACCEL_XYZ) {
+		return -ENOTSUP;
+	}
+	key = k_spin_lock(&lock);
+	for (int a = 0; a < 3; a++) {
+		/* raw * fs / 2^15 g, in um/s^2 */
+		int64_t ums2 = (int64_t)mean[a] * fs_g * 9806650 / 32768;
+
+		val[a].val1 = ums2 / 1000000;
+		val[a].val2 = ums2 % 1000000;
+	}
+	k_spin_unlock(&lock, key);
+	return 0;
+}
+
+/* Peak jerk since the previous call, mg */
+uint16_t sens_accel_activity_mg(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	uint16_t mg = activity_mg;
+
+	activity_mg = 0;
+	k_spin_unlock(&lock, key);
+	return mg;
+}
+
+void sens_accel_stats_get(struct sens_accel_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*stats = st;
+	k_spin_unlock(&lock, key);
+}
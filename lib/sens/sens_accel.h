@@ -0,0 +1,37 @@
+/**
+ * @file sens_accel.h
+ * @author Wilfred Mallawa
+ * @brief LIS2DH FIFO acquisition, the accelerometer free runs into its
+ *        FIFO and is drained in batches on the watermark interrupt.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_ACCEL_H
+#define SENS_ACCEL_H
+
+#include <stdint.h>
+#include <zephyr/drivers/sensor.h>
+
+/* FIFO acquisition counters, since boot unless noted */
+struct sens_accel_stats {
+    uint32_t samples;           //accelerometer samples drained
+    uint32_t batches;           //FIFO bursts read, one I2C read each
+    uint32_t wakeups;           //watermark interrupts (or timer polls)
+    uint32_t i2c_xfers;         //I2C transactions of the drain path
+    uint32_t overruns;          //batches that found the FIFO overrun
+    uint32_t knocks;            //batches with a jerk over the knock threshold
+    uint16_t peak_mg;           //largest sample to sample jerk, last batch
+    uint16_t odr_hz;
+};
+
+/* Function Declarations */
+extern int sens_accel_init(void);
+extern int sens_accel_fetch(void);
+extern int sens_accel_channel_get(enum sensor_channel chan,
+                                  struct sensor_value *val);
+extern uint16_t sens_accel_activity_mg(void);
+extern void sens_accel_stats_get(struct sens_accel_stats *stats);
+/* ---------------------- */
+
+#endif
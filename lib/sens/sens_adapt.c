@@ -0,0 +1,151 @@
+/**
+ * @file sens_adapt.c
+ * @author Wilfred Mallawa
+ * @brief Adaptive sample periods. Each source compares its channels with
+ *        the values at its previous sample. A change beyond the channel's
+ *        delta drops the source straight to its minimum period, while a
+ *        run of unchanged samples doubles the period up to its maximum.
+ *        Motion (accelerometer jerk in FIFO mode, else a tilt change)
+ *        ramps every source up, since the device is being carried or
+ *        handled. The battery keeps its fixed period for the fuel gauge.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+
+#include "sens_adapt.h"
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+#include "sens_accel.h"
+#endif
+
+LOG_MODULE_REGISTER(sens_adapt, CONFIG_LOG_DEFAULT_LEVEL);
+
+struct adapt_src {
+	uint8_t valid;			//SENS_VALID_* bit of the source
+	uint32_t min_ms;
+	uint32_t max_ms;
+	uint8_t stable;			//unchanged samples in a row
+	uint32_t ramps;			//drops to the minimum period
+};
+
+static struct adapt_src adapt[SENS_SRC_COUNT] = {
+	[SENS_SRC_HTS221] = { SENS_VALID_HTS221, CONFIG_APP_SENS_ADAPT_HTS221_MIN_MS,
+			      CONFIG_APP_SENS_ADAPT_HTS221_MAX_MS },
+	[SENS_SRC_LPS22HB] = { SENS_VALID_LPS22HB, CONFIG_APP_SENS_ADAPT_LPS22HB_MIN_MS,
+			       CONFIG_APP_SENS_ADAPT_LPS22HB_MAX_MS },
+	[SENS_SRC_LIS2DH] = { SENS_VALID_LIS2DH, CONFIG_APP_SENS_ADAPT_LIS2DH_MIN_MS,
+			      CONFIG_APP_SENS_ADAPT_LIS2DH_MAX_MS },
+	[SENS_SRC_CCS811] = { SENS_VALID_CCS811, CONFIG_APP_SENS_ADAPT_CCS811_MIN_MS,
+			      CONFIG_APP_SENS_ADAPT_CCS811_MAX_MS },
+};
+
+/* Values at each source's previous sample */
+static struct sens_packet ref;
+
+/* Did the channels of src move past their deltas since its last sample */
+static bool adapt_changed(enum sens_src src, const struct sens_packet *pkt)
+{
+	switch (src) {
+	case SENS_SRC_HTS221:
+		return abs(pkt->hts221_temp - ref.hts221_temp) >= CONFIG_APP_SENS_ADAPT_TEMP_DELTA ||
+		       abs(pkt->hts221_rh - ref.hts221_rh) >= CONFIG_APP_SENS_ADAPT_RH_DELTA;
+	case SENS_SRC_LPS22HB:
+		return abs((int32_t)(pkt->lps22hb_press - ref.lps22hb_press)) >=
+		       CONFIG_APP_SENS_ADAPT_PRESS_DELTA;
+	case SENS_SRC_LIS2DH:
+		return abs(pkt->xy_angle - ref.xy_angle) >= CONFIG_APP_SENS_ADAPT_ANGLE_DELTA;
+	case SENS_SRC_CCS811:
+		return abs(pkt->ccs811_eco2 - ref.ccs811_eco2) >= CONFIG_APP_SENS_ADAPT_ECO2_DELTA;
+	default:
+		return false;
+	}
+}
+
+/* Keep the channels of src as the reference for its next sample */
+static void adapt_ref(enum sens_src src, const struct sens_packet *pkt)
+{
+	switch (src) {
+	case SENS_SRC_HTS221:
+		ref.hts221_temp = pkt->hts221_temp;
+		ref.hts221_rh = pkt->hts221_rh;
+		break;
+	case SENS_SRC_LPS22HB:
+		ref.lps22hb_press = pkt->lps22hb_press;
+		break;
+	case SENS_SRC_LIS2DH:
+		ref.xy_angle = pkt->xy_angle;
+		break;
+	case SENS_SRC_CCS811:
+		ref.ccs811_eco2 = pkt->ccs811_eco2;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Fold one packet in and update period_ms for the sources it sampled.
+ * Returns the mask of sources whose period changed.
+ */
+uint32_t sens_adapt_update(const struct sens_packet *pkt,
+			   uint32_t period_ms[SENS_SRC_COUNT])
+{
+	static uint8_t seen;
+	uint32_t changed = 0;
+	bool motion = false;
+
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+	motion = sens_accel_activity_mg() >= CONFIG_APP_SENS_ADAPT_MOTION_MG;
+#endif
+	if ((pkt->valid & SENS_VALID_LIS2DH) && (seen & SENS_VALID_LIS2DH)) {
+		motion |= adapt_changed(SENS_SRC_LIS2DH, pkt);
+	}
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		struct adapt_src *a = &adapt[i];
+		uint32_t period = period_ms[i];
+		bool moved;
+
+		if (a->valid == 0) {
+			continue;
+		}
+		/* motion ramps every source, each other one waits for its sample */
+		moved = motion;
+		if (pkt->valid & a->valid) {
+			if (seen & a->valid) {
+				moved |= adapt_changed(i, pkt);
+			}
+			adapt_ref(i, pkt);
+			seen |= a->valid;
+		} else if (!moved) {
+			continue;
+		}
+
+		if (moved) {
+			a->stable = 0;
+			if (period != a->min_ms) {
+				a->ramps++;
+			}
+			period = a->min_ms;
+		} else if (++a->stable >= CONFIG_APP_SENS_ADAPT_STABLE) {
+			a->stable = 0;
+			period = MIN(period * 2, a->max_ms);
+		}
+		period = MAX(MIN(period, a->max_ms), a->min_ms);
+		if (period != period_ms[i]) {
+			LOG_DBG("%s: %u -> %u ms", sens_src_name(i), period_ms[i], period);
+			period_ms[i] = period;
+			changed |= BIT(i);
+		}
+	}
+	return changed;
+}
+
+uint32_t sens_adapt_ramps_get(enum sens_src src)
+{
+	return (src < SENS_SRC_COUNT) ? adapt[src].ramps : 0;
+}
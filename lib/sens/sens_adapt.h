@@ -0,0 +1,21 @@
+/**
+ * @file sens_adapt.h
+ * @author Wilfred Mallawa
+ * @brief Adaptive sample periods, long while the readings are flat and
+ *        short as soon as a channel or the device moves.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_ADAPT_H
+#define SENS_ADAPT_H
+
+#include "sens.h"
+
+/* Function Declarations */
+extern uint32_t sens_adapt_update(const struct sens_packet *pkt,
+                                  uint32_t period_ms[SENS_SRC_COUNT]);
+extern uint32_t sens_adapt_ramps_get(enum sens_src src);
+/* ---------------------- */
+
+#endif
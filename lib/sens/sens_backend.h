@@ -0,0 +1,50 @@
+/**
+ * @file sens_backend.h
+ * @author Wilfred Mallawa
+ * @brief Sensor backends, where sens_thread gets its readings from. The
+ *        hardware backend reads the Thingy52 sensors, the emulated one
+ *        synthesises plausible signals and the replay one plays back a
+ *        recorded field trace. One is selected at build time.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_BACKEND_H
+#define SENS_BACKEND_H
+
+#include <stdbool.h>
+#include <zephyr/drivers/sensor.h>
+
+#include "sens.h"
+
+/*
+ * Backend operations, per acquisition source. fetch does the transaction
+ * and returns 0 or -errno, the battery source returns mV instead. The
+ * channels of the last successful fetch are then read with channel_get.
+ * Sources in the triggered mask are not scheduled by period, they are
+ * fetched once ready reports new data, and the backend calls
+ * sens_sched_kick to wake the sensor thread when it does. A source
+ * missing from the present mask is never fetched, the others carry on.
+ */
+struct sens_backend {
+    const char *name;
+    int (*init)(void);
+    uint32_t (*present)(void);                  //optional, sources found by init
+    int (*cycle_begin)(void);                   //optional, before a sample cycle
+    int (*start)(enum sens_src src);            //optional, ahead of all fetches
+    int (*fetch)(enum sens_src src);
+    int (*channel_get)(enum sens_src src, enum sensor_channel chan,
+                       struct sensor_value *val);
+    const struct device *(*device)(enum sens_src src);  //for device PM, or NULL
+    uint32_t (*time_ms)(void);                  //sample timestamps
+    bool paced;                                 //false: cycle back to back
+    uint32_t (*triggered)(void);                //optional, sources on data-ready
+    uint32_t (*ready)(void);                    //optional, data-ready since last call
+};
+
+/* Function Declarations */
+extern const struct sens_backend *sens_backend_get(void);
+extern void sens_sched_kick(void);
+/* ---------------------- */
+
+#endif
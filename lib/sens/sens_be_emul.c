@@ -0,0 +1,167 @@
+/**
+ * @file sens_be_emul.c
+ * @author Wilfred Mallawa
+ * @brief Emulated sensor backend. Each source produces a slow periodic
+ *        signal around a typical indoor value plus small deterministic
+ *        noise, so the whole pipeline (filters, history, display) can run
+ *        on a board without the sensors, or on native_posix. Signal time
+ *        and noise follow each source's sample index, not the uptime, so
+ *        every run produces the same readings.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <math.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/drivers/sensor.h>
+
+#include "sens_backend.h"
+
+LOG_MODULE_REGISTER(sens_be_emul, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define PI          3.14159265358979
+#define GRAVITY     9.80665
+
+/* Channels of one source as of its last fetch, at most three */
+static struct sensor_value vals[SENS_SRC_COUNT][3];
+/* Per source sample index and signal time, one period per sample */
+static uint32_t samples[SENS_SRC_COUNT];
+static uint32_t sig_ms[SENS_SRC_COUNT];
+static uint32_t noise_state;
+
+/* Restart the noise at a state fixed by source and sample index */
+static void noise_seed(enum sens_src src, uint32_t idx)
+{
+	noise_state = 0x2545f491 ^ (idx * 0x9e3779b9) ^ ((src + 1) * 0x85ebca6b);
+	if (noise_state == 0) {
+		noise_state = 1;
+	}
+}
+
+/* xorshift32, +-amp */
+static double noise(double amp)
+{
+	noise_state ^= noise_state << 13;
+	noise_state ^= noise_state >> 17;
+	noise_state ^= noise_state << 5;
+	return amp * ((double)(noise_state & 0xffff) / 0x8000 - 1.0);
+}
+
+/* Phase of a cycle of period_s at t_ms, in radians */
+static double phase(uint32_t t_ms, uint32_t period_s)
+{
+	return 2 * PI * (t_ms % (period_s * MSEC_PER_SEC)) /
+	       (period_s * MSEC_PER_SEC);
+}
+
+static void value_set(struct sensor_value *val, double v)
+{
+	val->val1 = (int32_t)v;
+	val->val2 = (int32_t)((v - val->val1) * 1000000);
+}
+
+static int emul_init(void)
+{
+	LOG_INF("emulated sensors");
+	return 0;
+}
+
+static int emul_fetch(enum sens_src src)
+{
+	uint32_t t = sig_ms[src];
+	struct sensor_value *v;
+	double temp;
+	double a;
+
+	if (src >= SENS_SRC_COUNT) {
+		return -ENOTSUP;
+	}
+	noise_seed(src, samples[src]++);
+	sig_ms[src] += sens_sched_period_get(src);
+	v = vals[src];
+	temp = 21.5 + 2.0 * sin(phase(t, 600)) + noise(0.05);
+
+	switch (src) {
+	case SENS_SRC_HTS221:
+		value_set(&v[0], temp);
+		value_set(&v[1], 45.0 - 8.0 * sin(phase(t, 600)) + noise(0.3));
+		break;
+	case SENS_SRC_LPS22HB:
+		/* kPa, as the driver reports it */
+		value_set(&v[0], 101.325 + 0.4 * sin(phase(t, 3600)) + noise(0.005));
+		value_set(&v[1], temp + 0.3);
+		break;
+	case SENS_SRC_LIS2DH:
+		/* tilt sweeping +-30 degrees, m/s^2 */
+		a = 30.0 * sin(phase(t, 120)) / 180.0 * PI;
+		value_set(&v[0], GRAVITY * sin(a) + noise(0.05));
+		value_set(&v[1], GRAVITY * cos(a) + noise(0.05));
+		value_set(&v[2], noise(0.05));
+		break;
+	case SENS_SRC_CCS811:
+		a = 0.5 + 0.5 * sin(phase(t, 1800));
+		v[0].val1 = 400 + (int32_t)(800 * a + noise(10.0) + 10.0);
+		v[1].val1 = (int32_t)(200 * a + noise(3.0) + 3.0);
+		v[0].val2 = v[1].val2 = 0;
+		break;
+	case SENS_SRC_BATT:
+		/* full to flat over ten hours, then again */
+		return 4150 - (int)(800 * (t % (36000 * MSEC_PER_SEC)) /
+				    (36000 * MSEC_PER_SEC)) + (int)noise(4.0);
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static int emul_channel_get(enum sens_src src, enum sensor_channel chan,
+			    struct sensor_value *val)
+{
+	const struct sensor_value *v = vals[src];
+
+	switch (chan) {
+	case SENSOR_CHAN_AMBIENT_TEMP:
+		*val = (src == SENS_SRC_HTS221) ? v[0] : v[1];
+		return 0;
+	case SENSOR_CHAN_HUMIDITY:
+		*val = v[1];
+		return 0;
+	case SENSOR_CHAN_PRESS:
+	case SENSOR_CHAN_CO2:
+		*val = v[0];
+		return 0;
+	case SENSOR_CHAN_VOC:
+		*val = v[1];
+		return 0;
+	case SENSOR_CHAN_ACCEL_XYZ:
+		val[0] = v[0];
+		val[1] = v[1];
+		val[2] = v[2];
+		return 0;
+	default:
+		return -ENOTSUP;
+	}
+}
+
+static const struct device *emul_device(enum sens_src src)
+{
+	ARG_UNUSED(src);
+	return NULL;
+}
+
+const struct sens_backend *sens_backend_get(void)
+{
+	static const struct sens_backend be = {
+		.name = "emul",
+		.init = emul_init,
+		.fetch = emul_fetch,
+		.channel_get = emul_channel_get,
+		.device = emul_device,
+		.time_ms = k_uptime_get_32,
+		.paced = true,
+	};
+
+	return &be;
+}
@@ -0,0 +1,325 @@
+/**
+ * @file sens_be_hw.c
+ * @author Wilfred Mallawa
+ * @brief Hardware sensor backend, the Thingy52 sensors through the Zephyr
+ *        sensor API and the battery through the fuel gauge ADC path. Only
+ *        the sensors built in are looked up, and one that is missing or
+ *        fails to come up is reported and left out of the present mask.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#ifdef CONFIG_APP_SENS_CCS811
+#include <zephyr/drivers/sensor/ccs811.h>
+#endif
+
+#include "sens_backend.h"
+#include "sens_fuel.h"
+#include "sens_accel.h"
+#include "sens_ccs811.h"
+#include "battery.h"
+
+LOG_MODULE_REGISTER(sens_be_hw, CONFIG_LOG_DEFAULT_LEVEL);
+
+static const struct device *devs[SENS_SRC_COUNT];
+static uint32_t present;        //sources found and set up by hw_init
+static bool hts221_ok;          //HTS221 holds a good sample for envdata
+#ifdef CONFIG_APP_SENS_CCS811
+static bool app_fw_2;
+#endif
+
+#ifdef CONFIG_APP_MONITOR_BASELINE
+static int ccs811_baseline = -1;
+#endif
+
+#ifdef CONFIG_APP_SENS_DRDY
+static atomic_t drdy_ready;     //sources with a result not read yet
+static uint32_t drdy_mask;      //sources running on their data-ready line
+
+static void hw_drdy(const struct device *dev, const struct sensor_trigger *trig)
+{
+	ARG_UNUSED(trig);
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (devs[i] == dev) {
+			atomic_or(&drdy_ready, BIT(i));
+			sens_sched_kick();
+			return;
+		}
+	}
+}
+
+/*
+ * Move each climate sensor whose driver takes a data-ready trigger onto
+ * it. Drivers built without trigger support, or without the line in the
+ * devicetree, refuse and those sensors stay polled by period.
+ */
+static void hw_drdy_init(void)
+{
+	static const struct sensor_trigger trig = {
+		.type = SENSOR_TRIG_DATA_READY,
+		.chan = SENSOR_CHAN_ALL,
+	};
+	static const enum sens_src srcs[] = {
+		SENS_SRC_HTS221, SENS_SRC_LPS22HB, SENS_SRC_CCS811,
+	};
+
+	for (int i = 0; i < ARRAY_SIZE(srcs); i++) {
+		enum sens_src src = srcs[i];
+		int rc;
+
+		if (!(present & BIT(src))) {
+			continue;
+		}
+		rc = sensor_trigger_set(devs[src], &trig, hw_drdy);
+
+		if (rc == 0) {
+			drdy_mask |= BIT(src);
+			LOG_INF("%s: on data-ready", sens_src_name(src));
+		} else {
+			LOG_INF("%s: polled (%d)", sens_src_name(src), rc);
+		}
+	}
+}
+
+static uint32_t hw_triggered(void)
+{
+	return drdy_mask;
+}
+
+static uint32_t hw_ready(void)
+{
+	return atomic_clear(&drdy_ready);
+}
+#endif /* CONFIG_APP_SENS_DRDY */
+
+#ifdef CONFIG_APP_SENS_CCS811
+static void hw_ccs811_init(const struct device *dev)
+{
+	struct ccs811_configver_type cfgver;
+	int rc;
+
+	rc = ccs811_configver_fetch(dev, &cfgver);
+
+	if (rc == 0) {
+		LOG_INF("ccs811: HW %02x; FW Boot %04x App %04x ; mode %02x\n",
+		       cfgver.hw_version, cfgver.fw_boot_version,
+		       cfgver.fw_app_version, cfgver.mode);
+		app_fw_2 = (cfgver.fw_app_version >> 8) > 0x11;
+	}
+
+#ifdef CONFIG_APP_USE_DEF_ENVDATA
+	struct sensor_value temp = { CONFIG_APP_ENV_TEMPERATURE };
+	struct sensor_value humidity = { CONFIG_APP_ENV_HUMIDITY };
+
+	rc = ccs811_envdata_update(dev, &temp, &humidity);
+
+	LOG_INF("CCS811 Calibrated for %d Cel, %d %%RH Status %s : errno %d\n",
+			temp.val1, humidity.val1, rc ? "Calibration err" : "Okay", rc);
+#endif
+	/* A stored baseline, written back after warm-up, skips the learning */
+	sens_ccs811_init(dev);
+}
+#endif /* CONFIG_APP_SENS_CCS811 */
+
+static int hw_init(void)
+{
+#ifdef CONFIG_APP_SENS_HTS221
+	devs[SENS_SRC_HTS221] = device_get_binding("HTS221");
+#endif
+#ifdef CONFIG_APP_SENS_LPS22HB
+	devs[SENS_SRC_LPS22HB] = device_get_binding(DT_LABEL(DT_INST(0, st_lps22hb_press)));
+#endif
+#ifdef CONFIG_APP_SENS_CCS811
+	devs[SENS_SRC_CCS811] = device_get_binding(DT_LABEL(DT_INST(0, ams_ccs811)));
+#endif
+#ifdef CONFIG_APP_SENS_LIS2DH
+	devs[SENS_SRC_LIS2DH] = DEVICE_DT_GET_ANY(st_lis2dh);
+#endif
+
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (i == SENS_SRC_BATT || !(SENS_SRC_ENABLED & BIT(i))) {
+			continue;
+		}
+		if (devs[i] == NULL || !device_is_ready(devs[i])) {
+			LOG_ERR("%s: device not ready, left out\n", sens_src_name(i));
+			devs[i] = NULL;
+			continue;
+		}
+		present |= BIT(i);
+	}
+
+#ifdef CONFIG_APP_SENS_BATT
+	/* HW INIT/OK, in low power mode the divider is fed per sample */
+	if (!battery_ready()) {
+		LOG_ERR("battery: measurement not set up, left out\n");
+	} else {
+		present |= BIT(SENS_SRC_BATT);
+		if (!IS_ENABLED(CONFIG_APP_SENS_LOW_POWER) &&
+		    battery_measure_enable(true) != 0) {
+			LOG_ERR("failed to setup battery meas");
+		}
+	}
+#endif
+
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+	/* The driver did the part setup, batches take over from here */
+	if ((present & BIT(SENS_SRC_LIS2DH)) && sens_accel_init() != 0) {
+		LOG_ERR("lis2dh: fifo mode failed, left out\n");
+		present &= ~BIT(SENS_SRC_LIS2DH);
+	}
+#endif
+
+#ifdef CONFIG_APP_SENS_CCS811
+	if (present & BIT(SENS_SRC_CCS811)) {
+		hw_ccs811_init(devs[SENS_SRC_CCS811]);
+	}
+#endif
+#ifdef CONFIG_APP_SENS_DRDY
+	hw_drdy_init();
+#endif
+	return 0;
+}
+
+static uint32_t hw_present(void)
+{
+	return present;
+}
+
+/* Start the vBATT conversion, it completes while the sensors are read */
+static int hw_start(enum sens_src src)
+{
+#ifdef CONFIG_APP_SENS_BATT
+	if (src == SENS_SRC_BATT) {
+		return sens_fuel_start();
+	}
+#endif
+	return 0;
+}
+
+#ifdef CONFIG_APP_SENS_CCS811
+/* Fetch CCS811 result (and baseline when monitored), check its status */
+static int ccs811_fetch(const struct device *dev)
+{
+	const struct ccs811_result_type *rp;
+	int rc = 0;
+
+#ifdef CONFIG_APP_CCS811_ENV_LIVE
+	/* The HTS221 driver keeps its last sample, no bus traffic here */
+	if (hts221_ok) {
+		struct sensor_value temp, hum;
+
+		sensor_channel_get(devs[SENS_SRC_HTS221], SENSOR_CHAN_AMBIENT_TEMP, &temp);
+		sensor_channel_get(devs[SENS_SRC_HTS221], SENSOR_CHAN_HUMIDITY, &hum);
+		sens_ccs811_env(dev, &temp, &hum);
+	}
+#endif
+#ifdef CONFIG_APP_MONITOR_BASELINE
+	ccs811_baseline = -1;
+	rc = ccs811_baseline_fetch(dev);
+	if (rc >= 0) {
+		ccs811_baseline = rc;
+		rc = 0;
+	}
+#endif
+	if (rc == 0) {
+		rc = sensor_sample_fetch(dev);
+	}
+	if (rc != 0) {
+		return rc;
+	}
+
+#ifdef CONFIG_CCS811_VERBOSE
+	struct sensor_value voltage, current;
+
+	sensor_channel_get(dev, SENSOR_CHAN_VOLTAGE, &voltage);
+	sensor_channel_get(dev, SENSOR_CHAN_CURRENT, &current);
+	LOG_INF("ccs811: Voltage: %d.%06dV; Current: %d.%06dA\n", voltage.val1,
+	       voltage.val2, current.val1, current.val2);
+#endif
+#ifdef CONFIG_APP_MONITOR_BASELINE
+	LOG_INF("ccs811: baseline %04x\n", ccs811_baseline);
+#endif
+	rp = ccs811_result(dev);
+	if (app_fw_2 && !(rp->status & CCS811_STATUS_DATA_READY)) {
+		LOG_ERR("ccs811: stale data\n");
+	}
+
+	if (rp->status & CCS811_STATUS_ERROR) {
+		LOG_ERR("ccs811: status error: %02x\n", rp->error);
+	}
+	sens_ccs811_baseline_poll(dev);
+	return 0;
+}
+#endif /* CONFIG_APP_SENS_CCS811 */
+
+static int hw_fetch(enum sens_src src)
+{
+	int rc;
+
+	switch (src) {
+	case SENS_SRC_HTS221:
+		rc = sensor_sample_fetch(devs[src]);
+		hts221_ok = (rc == 0);
+		return rc;
+#ifdef CONFIG_APP_SENS_BATT
+	case SENS_SRC_BATT:
+		/* Collect the vBATT conversion started by hw_start */
+		return sens_fuel_read();
+#endif
+#ifdef CONFIG_APP_SENS_CCS811
+	case SENS_SRC_CCS811:
+		return ccs811_fetch(devs[src]);
+#endif
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+	case SENS_SRC_LIS2DH:
+		return sens_accel_fetch();
+#endif
+	default:
+		return sensor_sample_fetch(devs[src]);
+	}
+}
+
+static int hw_channel_get(enum sens_src src, enum sensor_channel chan,
+			  struct sensor_value *val)
+{
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+	if (src == SENS_SRC_LIS2DH) {
+		return sens_accel_channel_get(chan, val);
+	}
+#endif
+	return devs[src] ? sensor_channel_get(devs[src], chan, val) : -ENOTSUP;
+}
+
+static const struct device *hw_device(enum sens_src src)
+{
+	/* In FIFO mode the accelerometer free runs, never suspend it */
+	if (IS_ENABLED(CONFIG_APP_SENS_ACCEL_FIFO) && src == SENS_SRC_LIS2DH) {
+		return NULL;
+	}
+	return devs[src];
+}
+
+const struct sens_backend *sens_backend_get(void)
+{
+	static const struct sens_backend be = {
+		.name = "hw",
+		.init = hw_init,
+		.present = hw_present,
+		.start = hw_start,
+		.fetch = hw_fetch,
+		.channel_get = hw_channel_get,
+		.device = hw_device,
+		.time_ms = k_uptime_get_32,
+		.paced = true,
+#ifdef CONFIG_APP_SENS_DRDY
+		.triggered = hw_triggered,
+		.ready = hw_ready,
+#endif
+	};
+
+	return &be;
+}
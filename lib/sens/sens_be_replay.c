@@ -0,0 +1,332 @@
+/**
+ * @file sens_be_replay.c
+ * @author Wilfred Mallawa
+ * @brief Trace replay sensor backend. Plays back a recorded field trace in
+ *        the CSV format of 'sens history' (or 'sens log', boot column
+ *        first), either built into the image or, on native_posix, read
+ *        from a host file. Paced replay follows the trace timestamps in
+ *        real time, fast replay runs one record per sample cycle with no
+ *        sleeps and stamps samples with trace time. Lines are parsed as
+ *        they are reached, the trace is never held decoded in RAM.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <math.h>
+#include <string.h>
+#ifdef CONFIG_ARCH_POSIX
+#include <stdio.h>
+#endif
+
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/drivers/sensor.h>
+
+#include "sens_backend.h"
+
+LOG_MODULE_REGISTER(sens_be_replay, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define GRAVITY         9.80665
+#define REPLAY_LINE_MAX 128
+
+/* Built in trace, CONFIG_APP_SENS_REPLAY_TRACE as bytes */
+static const char trace[] = {
+#include "sens_replay_trace.inc"
+};
+
+struct replay_rec {
+	uint32_t t_ms;
+	bool wrapped;               //first record after a loop back
+	struct sens_packet pkt;
+};
+
+static struct {
+	size_t off;                 //built in trace read position
+#ifdef CONFIG_ARCH_POSIX
+	FILE *fp;                   //host file, instead of the built in trace
+#endif
+	bool boot_col;              //'sens log' form, boot number first
+	bool have_next;
+	bool fresh;                 //cur not sampled yet
+	struct replay_rec cur;
+	struct replay_rec next;
+	uint32_t t0_ms;             //trace time of the first record
+	uint32_t base_ms;           //uptime (paced) or trace time (fast) of t0
+	uint32_t step_ms;           //last record interval, spacing over a loop
+} rp = { .step_ms = MSEC_PER_SEC };
+
+/* Next line of the trace into buf, false at the end */
+static bool replay_gets(char *buf, size_t len)
+{
+	size_t n = 0;
+
+#ifdef CONFIG_ARCH_POSIX
+	if (rp.fp) {
+		if (fgets(buf, len, rp.fp) == NULL) {
+			return false;
+		}
+		buf[strcspn(buf, "\r\n")] = '\0';
+		return true;
+	}
+#endif
+	if (rp.off >= sizeof(trace)) {
+		return false;
+	}
+	while (rp.off < sizeof(trace) && trace[rp.off] != '\n') {
+		if (n < len - 1 && trace[rp.off] != '\r') {
+			buf[n++] = trace[rp.off];
+		}
+		rp.off++;
+	}
+	rp.off++;
+	buf[n] = '\0';
+	return true;
+}
+
+static void replay_rewind(void)
+{
+#ifdef CONFIG_ARCH_POSIX
+	if (rp.fp) {
+		rewind(rp.fp);
+	}
+#endif
+	rp.off = 0;
+}
+
+/* Decimal field in units of 1/scale, scale a power of ten */
+static int32_t parse_fixed(const char **p, int32_t scale)
+{
+	const char *s = *p;
+	bool neg = (*s == '-');
+	int32_t ip = 0, fp = 0, div = 1;
+
+	s += neg;
+	while (*s >= '0' && *s <= '9') {
+		ip = ip * 10 + (*s++ - '0');
+	}
+	if (*s == '.') {
+		s++;
+		while (*s >= '0' && *s <= '9') {
+			if (div < scale) {
+				fp = fp * 10 + (*s - '0');
+				div *= 10;
+			}
+			s++;
+		}
+	}
+	if (*s == ',') {
+		s++;
+	}
+	*p = s;
+	ip = ip * scale + fp * (scale / div);
+	return neg ? -ip : ip;
+}
+
+/* One CSV row into rec, false for headers and malformed rows */
+static bool replay_parse(const char *line, struct replay_rec *rec)
+{
+	const char *p = line;
+	struct sens_packet *pkt = &rec->pkt;
+
+	if (strncmp(line, "boot,", 5) == 0) {
+		rp.boot_col = true;
+		return false;
+	}
+	if (*line < '0' || *line > '9') {
+		return false;
+	}
+	if (rp.boot_col) {
+		parse_fixed(&p, 1);
+	}
+	rec->t_ms = parse_fixed(&p, 1);
+	pkt->hts221_temp = parse_fixed(&p, 100);
+	pkt->hts221_rh = parse_fixed(&p, 100);
+	pkt->lps22hb_press = parse_fixed(&p, 1);
+	pkt->lps22hb_temp = parse_fixed(&p, 100);
+	pkt->xy_angle = parse_fixed(&p, 100);
+	pkt->ccs811_eco2 = parse_fixed(&p, 1);
+	pkt->ccs811_etvoc = parse_fixed(&p, 1);
+	pkt->batt_mV = parse_fixed(&p, 1);
+	/* level and time to empty are left to the fuel gauge */
+	return true;
+}
+
+/* Next record of the trace, rewinding at the end when looping */
+static bool replay_read(struct replay_rec *rec)
+{
+	char line[REPLAY_LINE_MAX];
+
+	for (int pass = 0; pass < 2; pass++) {
+		while (replay_gets(line, sizeof(line))) {
+			if (replay_parse(line, rec)) {
+				rec->wrapped = (pass > 0);
+				return true;
+			}
+		}
+		if (!IS_ENABLED(CONFIG_APP_SENS_REPLAY_LOOP)) {
+			break;
+		}
+		replay_rewind();
+	}
+	return false;
+}
+
+/* Make next the current record, keeping trace time increasing over loops */
+static int replay_advance(void)
+{
+	if (!rp.have_next) {
+		return -ENODATA;
+	}
+	if (rp.next.wrapped) {
+		/* continue one record interval after the last record */
+		rp.base_ms += rp.cur.t_ms - rp.t0_ms + rp.step_ms;
+		rp.t0_ms = rp.next.t_ms;
+	} else if (rp.next.t_ms > rp.cur.t_ms) {
+		rp.step_ms = rp.next.t_ms - rp.cur.t_ms;
+	}
+	rp.cur = rp.next;
+	rp.fresh = true;
+	rp.have_next = replay_read(&rp.next);
+	return 0;
+}
+
+/* Trace time reached, offset so that the first record is at base_ms */
+static uint32_t replay_time_ms(void)
+{
+	return rp.base_ms + rp.cur.t_ms - rp.t0_ms;
+}
+
+static int replay_init(void)
+{
+#ifdef CONFIG_ARCH_POSIX
+	if (strlen(CONFIG_APP_SENS_REPLAY_FILE) > 0) {
+		rp.fp = fopen(CONFIG_APP_SENS_REPLAY_FILE, "r");
+		if (rp.fp == NULL) {
+			LOG_ERR("cannot open %s", CONFIG_APP_SENS_REPLAY_FILE);
+			return -ENOENT;
+		}
+	}
+#endif
+	if (!replay_read(&rp.next)) {
+		LOG_ERR("replay trace is empty");
+		return -ENODATA;
+	}
+	rp.have_next = true;
+	rp.t0_ms = rp.next.t_ms;
+	rp.cur.t_ms = rp.t0_ms;
+	rp.base_ms = IS_ENABLED(CONFIG_APP_SENS_REPLAY_FAST) ? 0 : k_uptime_get_32();
+	LOG_INF("replaying trace, %s", IS_ENABLED(CONFIG_APP_SENS_REPLAY_FAST) ?
+		"fast" : "paced");
+	return replay_advance();
+}
+
+/* Time the next record is due at, in the timebase of base_ms */
+static uint32_t replay_next_due(void)
+{
+	if (rp.next.wrapped) {
+		return replay_time_ms() + rp.step_ms;
+	}
+	return rp.base_ms + rp.next.t_ms - rp.t0_ms;
+}
+
+/*
+ * Paced replay moves to the last record due at the current uptime, fast
+ * replay to the following record. Once the last record of a trace that
+ * does not loop has been sampled there is nothing more to sample.
+ */
+static int replay_cycle_begin(void)
+{
+	if (IS_ENABLED(CONFIG_APP_SENS_REPLAY_FAST)) {
+		if (!rp.fresh && replay_advance() != 0) {
+			return -ENODATA;
+		}
+	} else {
+		while (rp.have_next &&
+		       (int32_t)(k_uptime_get_32() - replay_next_due()) >= 0) {
+			replay_advance();
+		}
+		if (!rp.have_next && !rp.fresh) {
+			return -ENODATA;
+		}
+	}
+	rp.fresh = false;
+	return 0;
+}
+
+static int replay_fetch(enum sens_src src)
+{
+	if (src == SENS_SRC_BATT) {
+		return rp.cur.pkt.batt_mV ? rp.cur.pkt.batt_mV : -ENODATA;
+	}
+	return 0;
+}
+
+static void value_set(struct sensor_value *val, int32_t v, int32_t scale)
+{
+	val->val1 = v / scale;
+	val->val2 = (v % scale) * (1000000 / scale);
+}
+
+static int replay_channel_get(enum sens_src src, enum sensor_channel chan,
+			      struct sensor_value *val)
+{
+	const struct sens_packet *pkt = &rp.cur.pkt;
+	double a;
+
+	switch (chan) {
+	case SENSOR_CHAN_AMBIENT_TEMP:
+		value_set(val, (src == SENS_SRC_HTS221) ? pkt->hts221_temp :
+			  pkt->lps22hb_temp, 100);
+		return 0;
+	case SENSOR_CHAN_HUMIDITY:
+		value_set(val, pkt->hts221_rh, 100);
+		return 0;
+	case SENSOR_CHAN_PRESS:
+		/* kPa, as the driver reports it */
+		value_set(val, pkt->lps22hb_press, 1000);
+		return 0;
+	case SENSOR_CHAN_CO2:
+		value_set(val, pkt->ccs811_eco2, 1);
+		return 0;
+	case SENSOR_CHAN_VOC:
+		value_set(val, pkt->ccs811_etvoc, 1);
+		return 0;
+	case SENSOR_CHAN_ACCEL_XYZ:
+		/* any vector at the recorded x/y tilt, in mm/s^2 */
+		a = pkt->xy_angle / (100 * RAD_TO_DEG);
+		value_set(&val[0], (int32_t)(GRAVITY * 1000 * sin(a)), 1000);
+		value_set(&val[1], (int32_t)(GRAVITY * 1000 * cos(a)), 1000);
+		value_set(&val[2], 0, 1000);
+		return 0;
+	default:
+		return -ENOTSUP;
+	}
+}
+
+static const struct device *replay_device(enum sens_src src)
+{
+	ARG_UNUSED(src);
+	return NULL;
+}
+
+static uint32_t replay_clock_ms(void)
+{
+	return IS_ENABLED(CONFIG_APP_SENS_REPLAY_FAST) ? replay_time_ms() :
+	       k_uptime_get_32();
+}
+
+const struct sens_backend *sens_backend_get(void)
+{
+	static const struct sens_backend be = {
+		.name = "replay",
+		.init = replay_init,
+		.cycle_begin = replay_cycle_begin,
+		.fetch = replay_fetch,
+		.channel_get = replay_channel_get,
+		.device = replay_device,
+		.time_ms = replay_clock_ms,
+		.paced = !IS_ENABLED(CONFIG_APP_SENS_REPLAY_FAST),
+	};
+
+	return &be;
+}
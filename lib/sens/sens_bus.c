@@ -0,0 +1,145 @@
+/**
+ * @file sens_bus.c
+ * @author Wilfred Mallawa
+ * @brief Latest-value sensor data bus. Packets live in a small ring, the
+ *        publisher overwrites the oldest slot and bumps a sequence number.
+ *        Subscribers get a pointer into the ring instead of a copy, and
+ *        confirm with sens_bus_release() that the slot was not recycled
+ *        while they used it (seqlock style). A slow subscriber only loses
+ *        the oldest packets, never the whole backlog or the other
+ *        subscribers' data.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+#include "sens_bus.h"
+
+LOG_MODULE_REGISTER(sens_bus, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define RING_DEPTH CONFIG_APP_SENS_BUS_DEPTH
+
+BUILD_ASSERT(RING_DEPTH >= 2, "bus needs a spare slot for the writer");
+
+static struct sens_packet ring[RING_DEPTH];
+/* Sequence of the newest complete packet, 0 until the first publish */
+static atomic_t head;
+static sys_slist_t subs;
+static struct k_spinlock subs_lock;
+
+/* Slot sequence seq lives in */
+static inline struct sens_packet *slot(uint32_t seq)
+{
+	return &ring[seq % RING_DEPTH];
+}
+
+/* Oldest sequence that the writer cannot be overwriting right now */
+static inline uint32_t oldest_safe(uint32_t newest)
+{
+	return (newest > RING_DEPTH - 2) ? newest - (RING_DEPTH - 2) : 1;
+}
+
+void sens_bus_publish(const struct sens_packet *pkt)
+{
+	uint32_t seq = (uint32_t)atomic_get(&head) + 1;
+	struct sens_bus_sub *sub;
+	k_spinlock_key_t key;
+
+	*slot(seq) = *pkt;
+	/* atomic ops are full barriers, the slot is complete before head moves */
+	atomic_set(&head, seq);
+
+	key = k_spin_lock(&subs_lock);
+	SYS_SLIST_FOR_EACH_CONTAINER(&subs, sub, node) {
+		k_sem_give(&sub->sem);
+	}
+	k_spin_unlock(&subs_lock, key);
+}
+
+void sens_bus_subscribe(struct sens_bus_sub *sub)
+{
+	k_spinlock_key_t key;
+
+	k_sem_init(&sub->sem, 0, 1);
+	sub->seq = (uint32_t)atomic_get(&head);
+	sub->dropped = 0;
+
+	key = k_spin_lock(&subs_lock);
+	sys_slist_append(&subs, &sub->node);
+	k_spin_unlock(&subs_lock, key);
+}
+
+/* Block until there is a packet newer than the last one handed out */
+static uint32_t wait_newest(struct sens_bus_sub *sub, k_timeout_t timeout)
+{
+	uint32_t newest;
+
+	/* Consume a stale kick first, head is read after it so none is lost */
+	(void)k_sem_take(&sub->sem, K_NO_WAIT);
+	newest = (uint32_t)atomic_get(&head);
+
+	while (newest == sub->seq) {
+		if (k_sem_take(&sub->sem, timeout) != 0) {
+			return 0;
+		}
+		newest = (uint32_t)atomic_get(&head);
+	}
+	return newest;
+}
+
+/*
+ * Next unread packet, in publish order. If the publisher lapped this
+ * subscriber the oldest packets are skipped and counted as dropped.
+ * Returns NULL on timeout.
+ */
+const struct sens_packet *sens_bus_get(struct sens_bus_sub *sub,
+				       k_timeout_t timeout)
+{
+	uint32_t newest = wait_newest(sub, timeout);
+	uint32_t next;
+
+	if (newest == 0) {
+		return NULL;
+	}
+	next = MAX(sub->seq + 1, oldest_safe(newest));
+	sub->dropped += next - (sub->seq + 1);
+	sub->seq = next;
+	return slot(next);
+}
+
+/* Newest packet, skipping anything published in between. NULL on timeout. */
+const struct sens_packet *sens_bus_get_latest(struct sens_bus_sub *sub,
+					      k_timeout_t timeout)
+{
+	uint32_t newest = wait_newest(sub, timeout);
+
+	if (newest == 0) {
+		return NULL;
+	}
+	sub->seq = newest;
+	return slot(newest);
+}
+
+/* Packet last handed out again, e.g. to redraw it. NULL before the first. */
+const struct sens_packet *sens_bus_peek(const struct sens_bus_sub *sub)
+{
+	return (sub->seq != 0) ? slot(sub->seq) : NULL;
+}
+
+/*
+ * Done with the packet returned by the last get. Returns false if the
+ * publisher recycled the slot meanwhile, the data read may be torn.
+ */
+bool sens_bus_release(const struct sens_bus_sub *sub)
+{
+	return sub->seq >= oldest_safe((uint32_t)atomic_get(&head));
+}
+
+/* Sequence of the newest packet, counts publishes since boot */
+uint32_t sens_bus_seq(void)
+{
+	return (uint32_t)atomic_get(&head);
+}
@@ -0,0 +1,37 @@
+/**
+ * @file sens_bus.h
+ * @author Wilfred Mallawa
+ * @brief Latest-value sensor data bus, one publisher (sens_thread) and any
+ *        number of subscribers, each reading packets in place.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_BUS_H
+#define SENS_BUS_H
+
+#include <zephyr/zephyr.h>
+#include <zephyr/sys/slist.h>
+#include "sens.h"
+
+/* Subscriber state, owned by the consumer */
+struct sens_bus_sub {
+    sys_snode_t node;
+    struct k_sem sem;       //given on every publish
+    uint32_t seq;           //sequence of the packet last handed out
+    uint32_t dropped;       //packets overwritten before this sub read them
+};
+
+/* Function Declarations */
+extern void sens_bus_publish(const struct sens_packet *pkt);
+extern void sens_bus_subscribe(struct sens_bus_sub *sub);
+extern const struct sens_packet *sens_bus_get(struct sens_bus_sub *sub,
+                                              k_timeout_t timeout);
+extern const struct sens_packet *sens_bus_get_latest(struct sens_bus_sub *sub,
+                                                     k_timeout_t timeout);
+extern const struct sens_packet *sens_bus_peek(const struct sens_bus_sub *sub);
+extern bool sens_bus_release(const struct sens_bus_sub *sub);
+extern uint32_t sens_bus_seq(void);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file sens_ccs811.c
+ * @author Wilfred Mallawa
+ * @brief CCS811 warm start and environmental compensation. The baseline
+ *        the sensor has learnt is read back once per save period and kept
+ *        in the settings store when it changed. It is loaded at boot and
+ *        written back once the sensor has warmed up, as the datasheet
+ *        asks, so the algorithm resumes from it instead of learning a
+ *        new one. The HTS221 readings are programmed as the
+ *        sensor's envdata, only once they moved past a threshold since
+ *        the last write.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/drivers/sensor/ccs811.h>
+#ifdef CONFIG_APP_CCS811_BASELINE_STORE
+#include <zephyr/settings/settings.h>
+#endif
+
+#include "sens.h"
+#include "sens_ccs811.h"
+
+LOG_MODULE_REGISTER(sens_ccs811, CONFIG_LOG_DEFAULT_LEVEL);
+
+static struct sens_ccs811_stats st = { .baseline = -1, .env_temp = INT16_MIN };
+
+#ifdef CONFIG_APP_CCS811_BASELINE_STORE
+#define SAVE_MS     (CONFIG_APP_CCS811_BASELINE_SAVE_MIN * 60 * MSEC_PER_SEC)
+#define WARMUP_MS   (CONFIG_APP_CCS811_BASELINE_WARMUP_MIN * 60 * MSEC_PER_SEC)
+
+static int32_t stored = -1;             //baseline in the settings store
+static int64_t next_save_ms = SAVE_MS;
+
+static int ccs811_settings_set(const char *name, size_t len,
+			       settings_read_cb read_cb, void *cb_arg)
+{
+	uint16_t baseline;
+
+	if (strcmp(name, "baseline") != 0 || len != sizeof(baseline)) {
+		return -ENOENT;
+	}
+	if (read_cb(cb_arg, &baseline, sizeof(baseline)) != sizeof(baseline)) {
+		return -EIO;
+	}
+	stored = baseline;
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(ccs811, "ccs811", NULL, ccs811_settings_set,
+			       NULL, NULL);
+#endif /* CONFIG_APP_CCS811_BASELINE_STORE */
+
+/* Load the stored baseline, if there is one, it is restored after warm-up */
+int sens_ccs811_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+#ifdef CONFIG_APP_CCS811_BASELINE_STORE
+	int rc = settings_subsys_init();
+
+	if (rc == 0) {
+		rc = settings_load_subtree("ccs811");
+	}
+	if (rc != 0) {
+		LOG_ERR("ccs811: settings load failed: %d", rc);
+		return rc;
+	}
+	if (stored < 0) {
+		LOG_INF("ccs811: no stored baseline, learning one");
+		return 0;
+	}
+	LOG_INF("ccs811: baseline %04x stored, restoring after %u min warm-up",
+		stored, CONFIG_APP_CCS811_BASELINE_WARMUP_MIN);
+#endif
+	return 0;
+}
+
+#ifdef CONFIG_APP_CCS811_BASELINE_STORE
+/*
+ * Written before warm-up, the baseline would be overwritten by the
+ * algorithm's own start. No saves until it is in, or they would store
+ * the baseline being relearnt over the good one.
+ */
+static void baseline_restore(const struct device *dev, int64_t now)
+{
+	int rc = ccs811_baseline_update(dev, stored);
+
+	if (rc != 0) {
+		LOG_ERR("ccs811: baseline restore failed: %d", rc);
+		return;
+	}
+	st.baseline = stored;
+	st.restored = true;
+	next_save_ms = now + SAVE_MS;
+	LOG_INF("ccs811: baseline %04x restored", stored);
+}
+#endif /* CONFIG_APP_CCS811_BASELINE_STORE */
+
+#ifdef CONFIG_APP_CCS811_ENV_LIVE
+/*
+ * Program temperature and humidity when either moved past its threshold
+ * since the last write. Values come in as the HTS221 reports them.
+ */
+void sens_ccs811_env(const struct device *dev, const struct sensor_value *temp,
+		     const struct sensor_value *rh)
+{
+	int32_t t = sens_value_to_fixed(temp, 100);
+	int32_t h = sens_value_to_fixed(rh, 100);
+	int rc;
+
+	if (abs(t - st.env_temp) < CONFIG_APP_CCS811_ENV_TEMP_DELTA &&
+	    abs(h - st.env_rh) < CONFIG_APP_CCS811_ENV_RH_DELTA) {
+		return;
+	}
+	rc = ccs811_envdata_update(dev, temp, rh);
+	if (rc != 0) {
+		LOG_WRN("ccs811: envdata update failed: %d", rc);
+		return;
+	}
+	st.env_temp = t;
+	st.env_rh = h;
+	st.env_updates++;
+	LOG_DBG("ccs811: envdata %d cC %u c%%RH", t, h);
+}
+#endif /* CONFIG_APP_CCS811_ENV_LIVE */
+
+/*
+ * Restore the stored baseline once warmed up, then once per save period
+ * read it back and store it when it differs from the stored one. Called
+ * after a good result, so the sensor is in application mode. Without the
+ * store there is nothing to keep, and no read.
+ */
+void sens_ccs811_baseline_poll(const struct device *dev)
+{
+#ifdef CONFIG_APP_CCS811_BASELINE_STORE
+	int64_t now = k_uptime_get();
+	uint16_t baseline;
+	int rc;
+
+	if (stored >= 0 && !st.restored) {
+		if (now >= WARMUP_MS) {
+			baseline_restore(dev, now);
+		}
+		return;
+	}
+	if (now < next_save_ms) {
+		return;
+	}
+	next_save_ms = now + SAVE_MS;
+
+	rc = ccs811_baseline_fetch(dev);
+	if (rc < 0) {
+		LOG_WRN("ccs811: baseline fetch failed: %d", rc);
+		return;
+	}
+	baseline = rc;
+	st.baseline = baseline;
+	LOG_DBG("ccs811: baseline %04x", baseline);
+	if (baseline == stored) {
+		return;
+	}
+	rc = settings_save_one("ccs811/baseline", &baseline, sizeof(baseline));
+	if (rc != 0) {
+		LOG_ERR("ccs811: baseline save failed: %d", rc);
+		return;
+	}
+	stored = baseline;
+	st.saves++;
+#else
+	ARG_UNUSED(dev);
+#endif
+}
+
+void sens_ccs811_stats_get(struct sens_ccs811_stats *stats)
+{
+	*stats = st;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file sens_ccs811.h
+ * @author Wilfred Mallawa
+ * @brief CCS811 baseline persistence and live environmental compensation.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_CCS811_H
+#define SENS_CCS811_H
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+
+/* Baseline and compensation counters */
+struct sens_ccs811_stats {
+    int32_t baseline;           //last baseline read or restored, -1 if none
+    bool restored;              //stored baseline written back after warm-up
+    uint32_t saves;             //baselines written to settings
+    uint32_t env_updates;       //envdata writes from live readings
+    int16_t env_temp;           //last programmed, centi-celsius
+    uint16_t env_rh;            //last programmed, centi-rh%
+};
+
+/* Function Declarations */
+extern int sens_ccs811_init(const struct device *dev);
+extern void sens_ccs811_env(const struct device *dev,
+                            const struct sensor_value *temp,
+                            const struct sensor_value *rh);
+extern void sens_ccs811_baseline_poll(const struct device *dev);
+extern void sens_ccs811_stats_get(struct sens_ccs811_stats *stats);
+/* ---------------------- */
+
+#endif
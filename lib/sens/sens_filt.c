@@ -0,0 +1,210 @@
+/**
+ * @file sens_filt.c
+ * @author Wilfred Mallawa
+ * @brief Per-channel signal conditioning in fixed point. Readings go
+ *        through the stages set in their channel's Kconfig mask, median
+ *        first to drop spikes, then the smoothing stages. All state is
+ *        static, and every stage is seeded with a channel's first reading
+ *        so nothing ramps up from zero at boot. The cycles each stage
+ *        takes are kept for the 'sens filter' shell command. The stages
+ *        are plain C rather than the CMSIS-DSP kernels (CONFIG_CMSIS_DSP),
+ *        which are block oriented and would cost more flash than these
+ *        one reading per call routines, and the Q formats stay ours.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <zephyr/zephyr.h>
+#include <zephyr/sys/util.h>
+
+#include "sens_filt.h"
+
+#define MEDIAN_N    CONFIG_APP_SENS_FILT_MEDIAN_N
+#define STATE_FRAC  8                   //fraction bits of smoothed state
+#define COEF_FRAC   24                  //biquad coefficients, Q24
+
+BUILD_ASSERT((MEDIAN_N & 1) == 1, "median window must be odd");
+
+/*
+ * Butterworth low-pass coefficients for fc = FC_PERMILLE / 1000 of the
+ * sample rate, from the bilinear transform. tan() is its series to the
+ * 7th power, within 0.2% up to 0.2 fs, so the compiler folds the whole
+ * thing into integer constants.
+ */
+#define BQ_W        (3.14159265 * CONFIG_APP_SENS_FILT_BIQUAD_FC_PERMILLE / 1000.0)
+#define BQ_K        (BQ_W + BQ_W * BQ_W * BQ_W / 3 + \
+		     2 * BQ_W * BQ_W * BQ_W * BQ_W * BQ_W / 15 + \
+		     17 * BQ_W * BQ_W * BQ_W * BQ_W * BQ_W * BQ_W * BQ_W / 315)
+#define BQ_NORM     (1.0 / (1.0 + 1.41421356 * BQ_K + BQ_K * BQ_K))
+#define BQ_Q(v)     ((int64_t)((v) * (1 << COEF_FRAC) + ((v) < 0 ? -0.5 : 0.5)))
+
+static const int64_t bq_b0 = BQ_Q(BQ_K * BQ_K * BQ_NORM);
+static const int64_t bq_a1 = BQ_Q(2.0 * (BQ_K * BQ_K - 1.0) * BQ_NORM);
+/* (1 - sqrt(2) K + K^2) * norm, taken so the DC gain is exactly one */
+static const int64_t bq_a2 = 4 * BQ_Q(BQ_K * BQ_K * BQ_NORM) - (1 << COEF_FRAC) -
+			     BQ_Q(2.0 * (BQ_K * BQ_K - 1.0) * BQ_NORM);
+
+struct filt_chan {
+	bool seeded;
+	uint8_t median_pos;
+	int32_t median[MEDIAN_N];
+	int32_t ema;                    //<< STATE_FRAC
+	int32_t bq_x[2];
+	int64_t bq_y[2];                //<< STATE_FRAC
+	int32_t kf_x;                   //<< STATE_FRAC
+	uint32_t kf_p;                  //estimate variance, units^2 << STATE_FRAC
+};
+
+static const uint32_t chan_stages[SENS_FILT_CHAN_COUNT] = {
+	[SENS_FILT_TEMP] = CONFIG_APP_SENS_FILT_TEMP_STAGES,
+	[SENS_FILT_RH] = CONFIG_APP_SENS_FILT_RH_STAGES,
+	[SENS_FILT_PRESS] = CONFIG_APP_SENS_FILT_PRESS_STAGES,
+	[SENS_FILT_PTEMP] = CONFIG_APP_SENS_FILT_PTEMP_STAGES,
+	[SENS_FILT_ECO2] = CONFIG_APP_SENS_FILT_ECO2_STAGES,
+	[SENS_FILT_TVOC] = CONFIG_APP_SENS_FILT_TVOC_STAGES,
+};
+
+static const char *const chan_names[SENS_FILT_CHAN_COUNT] = {
+	"temp", "rh", "press", "ptemp", "eco2", "tvoc",
+};
+
+static const char *const stage_names[SENS_FILT_STAGE_COUNT] = {
+	"median", "kalman", "biquad", "ema",
+};
+
+static struct filt_chan chans[SENS_FILT_CHAN_COUNT];
+static struct sens_filt_cost costs[SENS_FILT_STAGE_COUNT];
+
+/* Rounded back to channel units */
+static inline int32_t unfrac(int64_t v)
+{
+	int64_t half = 1 << (STATE_FRAC - 1);
+
+	return (v + (v >= 0 ? half : -half)) / (1 << STATE_FRAC);
+}
+
+static void filt_seed(struct filt_chan *c, int32_t val)
+{
+	for (int i = 0; i < MEDIAN_N; i++) {
+		c->median[i] = val;
+	}
+	c->ema = val * (1 << STATE_FRAC);
+	c->bq_x[0] = c->bq_x[1] = val;
+	c->bq_y[0] = c->bq_y[1] = (int64_t)val * (1 << STATE_FRAC);
+	c->kf_x = val * (1 << STATE_FRAC);
+	c->kf_p = CONFIG_APP_SENS_FILT_KALMAN_R << STATE_FRAC;
+	c->seeded = true;
+}
+
+/* Median of the last MEDIAN_N readings, insertion sort of a copy */
+static int32_t filt_median(struct filt_chan *c, int32_t val)
+{
+	int32_t s[MEDIAN_N];
+
+	c->median[c->median_pos] = val;
+	c->median_pos = (c->median_pos + 1) % MEDIAN_N;
+
+	for (int i = 0; i < MEDIAN_N; i++) {
+		int32_t v = c->median[i];
+		int j = i;
+
+		for (; j > 0 && s[j - 1] > v; j--) {
+			s[j] = s[j - 1];
+		}
+		s[j] = v;
+	}
+	return s[MEDIAN_N / 2];
+}
+
+/*
+ * Random walk model: the variance grows by Q per reading and each
+ * reading of variance R pulls the estimate in by the gain P / (P + R).
+ */
+static int32_t filt_kalman(struct filt_chan *c, int32_t val)
+{
+	uint32_t r = CONFIG_APP_SENS_FILT_KALMAN_R << STATE_FRAC;
+	uint32_t p = c->kf_p + (CONFIG_APP_SENS_FILT_KALMAN_Q << STATE_FRAC);
+	int32_t gain = ((uint64_t)p << 15) / (p + r);      //Q15
+
+	c->kf_x += ((int64_t)gain * (val * (1 << STATE_FRAC) - c->kf_x)) >> 15;
+	c->kf_p = p - (((uint64_t)gain * p) >> 15);
+	return unfrac(c->kf_x);
+}
+
+/* Direct form I, b1 = 2 b0 and b2 = b0 for the low-pass */
+static int32_t filt_biquad(struct filt_chan *c, int32_t val)
+{
+	int64_t acc;
+
+	acc = bq_b0 * ((int64_t)val + 2 * c->bq_x[0] + c->bq_x[1]) * (1 << STATE_FRAC);
+	acc -= bq_a1 * c->bq_y[0] + bq_a2 * c->bq_y[1];
+	acc >>= COEF_FRAC;
+
+	c->bq_x[1] = c->bq_x[0];
+	c->bq_x[0] = val;
+	c->bq_y[1] = c->bq_y[0];
+	c->bq_y[0] = acc;
+	return unfrac(acc);
+}
+
+static int32_t filt_ema(struct filt_chan *c, int32_t val)
+{
+	c->ema += (val * (1 << STATE_FRAC) - c->ema) / (1 << CONFIG_APP_SENS_FILT_EMA_SHIFT);
+	return unfrac(c->ema);
+}
+
+static int32_t (*const stage_fn[SENS_FILT_STAGE_COUNT])(struct filt_chan *, int32_t) = {
+	[SENS_FILT_MEDIAN] = filt_median,
+	[SENS_FILT_KALMAN] = filt_kalman,
+	[SENS_FILT_BIQUAD] = filt_biquad,
+	[SENS_FILT_EMA] = filt_ema,
+};
+
+/* Condition one reading of chan, called from the sensor thread only */
+int32_t sens_filt_run(enum sens_filt_chan chan, int32_t val)
+{
+	struct filt_chan *c = &chans[chan];
+	uint32_t stages = chan_stages[chan];
+
+	if (stages == 0) {
+		return val;
+	}
+	if (!c->seeded) {
+		filt_seed(c, val);
+	}
+	for (int s = 0; s < SENS_FILT_STAGE_COUNT; s++) {
+		struct sens_filt_cost *cost = &costs[s];
+		uint32_t t0;
+
+		if (!(stages & BIT(s))) {
+			continue;
+		}
+		t0 = k_cycle_get_32();
+		val = stage_fn[s](c, val);
+		cost->last_cyc = k_cycle_get_32() - t0;
+		cost->max_cyc = MAX(cost->max_cyc, cost->last_cyc);
+		cost->total_cyc += cost->last_cyc;
+		cost->calls++;
+	}
+	return val;
+}
+
+uint32_t sens_filt_stages(enum sens_filt_chan chan)
+{
+	return chan_stages[chan];
+}
+
+const char *sens_filt_chan_name(enum sens_filt_chan chan)
+{
+	return chan_names[chan];
+}
+
+const char *sens_filt_stage_name(enum sens_filt_stage stage)
+{
+	return stage_names[stage];
+}
+
+void sens_filt_cost_get(enum sens_filt_stage stage, struct sens_filt_cost *cost)
+{
+	*cost = costs[stage];
+}
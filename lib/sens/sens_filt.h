@@ -0,0 +1,52 @@
+/**
+ * @file sens_filt.h
+ * @author Wilfred Mallawa
+ * @brief Per-channel signal conditioning. Each channel runs the stages
+ *        picked for it at build time, in the order of enum sens_filt_stage.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_FILT_H
+#define SENS_FILT_H
+
+#include <stdint.h>
+
+/* Filtered channels, in packet units */
+enum sens_filt_chan {
+    SENS_FILT_TEMP,             //hts221, centi-celsius
+    SENS_FILT_RH,               //hts221, centi-rh%
+    SENS_FILT_PRESS,            //lps22hb, Pa
+    SENS_FILT_PTEMP,            //lps22hb, centi-celsius
+    SENS_FILT_ECO2,             //ccs811, ppm
+    SENS_FILT_TVOC,             //ccs811, ppb
+    SENS_FILT_CHAN_COUNT,
+};
+
+/* Stages, a channel's APP_SENS_FILT_*_STAGES mask has BIT(stage) set */
+enum sens_filt_stage {
+    SENS_FILT_MEDIAN,           //median of the last N, drops spikes
+    SENS_FILT_KALMAN,           //scalar random walk Kalman
+    SENS_FILT_BIQUAD,           //2nd order Butterworth low-pass
+    SENS_FILT_EMA,              //exponential moving average
+    SENS_FILT_STAGE_COUNT,
+};
+
+/* Cost of one stage, over all channels running it */
+struct sens_filt_cost {
+    uint32_t calls;
+    uint32_t last_cyc;
+    uint32_t max_cyc;
+    uint64_t total_cyc;
+};
+
+/* Function Declarations */
+extern int32_t sens_filt_run(enum sens_filt_chan chan, int32_t val);
+extern uint32_t sens_filt_stages(enum sens_filt_chan chan);
+extern const char *sens_filt_chan_name(enum sens_filt_chan chan);
+extern const char *sens_filt_stage_name(enum sens_filt_stage stage);
+extern void sens_filt_cost_get(enum sens_filt_stage stage,
+                               struct sens_filt_cost *cost);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * @file sens_fuel.c
+ * @author Wilfred Mallawa
+ * @brief Battery fuel gauge on top of battery.c. The ADC conversion is
+ *        started asynchronously at the beginning of a sample cycle and
+ *        collected after the I2C sensors have been read. Readings go
+ *        through a median of three and an EMA, and the published voltage
+ *        only moves once the filtered value leaves a hysteresis band.
+ *        Voltage maps to level through a table built by the preprocessor
+ *        from the devicetree discharge curve (chosen app,battery-curve),
+ *        so a lookup is an index and one interpolation. The discharge rate
+ *        is the level drop over a fixed window, smoothed, and gives the
+ *        time to empty.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/logging/log.h>
+
+#include "sens_fuel.h"
+#include "battery.h"
+
+LOG_MODULE_REGISTER(sens_fuel, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*
+ * Discharge curve, points in decreasing voltage and level, at most
+ * CURVE_MAX of them. CURVE_HAS(k) must expand to a literal 1 or 0.
+ */
+#define CURVE_MAX 8
+
+#if DT_HAS_CHOSEN(app_battery_curve)
+#define CURVE               DT_CHOSEN(app_battery_curve)
+#define CURVE_HAS(k)        DT_PROP_HAS_IDX(CURVE, curve_mv, k)
+#define CURVE_MV(k)         DT_PROP_BY_IDX(CURVE, curve_mv, k)
+#define CURVE_PPTT(k)       DT_PROP_BY_IDX(CURVE, curve_pptt, k)
+BUILD_ASSERT(DT_PROP_LEN(CURVE, curve_mv) == DT_PROP_LEN(CURVE, curve_pptt),
+	     "curve-mv and curve-pptt must pair up");
+BUILD_ASSERT(DT_PROP_LEN(CURVE, curve_mv) >= 2 &&
+	     DT_PROP_LEN(CURVE, curve_mv) <= CURVE_MAX, "curve size");
+#else
+/* Linear from maximum voltage to minimum voltage. */
+#define CURVE_HAS_0         1
+#define CURVE_HAS_1         1
+#define CURVE_HAS(k)        IS_ENABLED(CURVE_HAS_##k)
+#define CURVE_MV(k)         ((k) ? 1700 : 3600)
+#define CURVE_PPTT(k)       ((k) ? 0 : 10000)
+#endif
+
+/* Value of the last curve point */
+#define LAST_TERM(k, k1, val) COND_CODE_1(CURVE_HAS(k1), (), \
+	(COND_CODE_1(CURVE_HAS(k), (+ val(k)), ())))
+#define CURVE_LAST(val) (0 LAST_TERM(0, 1, val) LAST_TERM(1, 2, val) \
+	LAST_TERM(2, 3, val) LAST_TERM(3, 4, val) LAST_TERM(4, 5, val) \
+	LAST_TERM(5, 6, val) LAST_TERM(6, 7, val) LAST_TERM(7, 8, val))
+
+/* Interpolated level of v if it falls in segment k..k1, else 0 */
+#define SEG(k, k1, v) COND_CODE_1(CURVE_HAS(k1), \
+	(+ (((v) < CURVE_MV(k) && (v) >= CURVE_MV(k1)) ? \
+	    CURVE_PPTT(k1) + (CURVE_PPTT(k) - CURVE_PPTT(k1)) * \
+	    ((v) - CURVE_MV(k1)) / (CURVE_MV(k) - CURVE_MV(k1)) : 0)), ())
+
+/* Same result as battery_level_pptt(), as a constant expression */
+#define CURVE_AT(v) ((v) >= CURVE_MV(0) ? CURVE_PPTT(0) : \
+	(v) < CURVE_LAST(CURVE_MV) ? CURVE_LAST(CURVE_PPTT) : \
+	(0 SEG(0, 1, v) SEG(1, 2, v) SEG(2, 3, v) SEG(3, 4, v) \
+	 SEG(4, 5, v) SEG(5, 6, v) SEG(6, 7, v)))
+
+#define LUT_SIZE    64
+#define LUT_MIN_MV  CURVE_LAST(CURVE_MV)
+#define LUT_STEP    DIV_ROUND_UP(CURVE_MV(0) - LUT_MIN_MV, LUT_SIZE - 1)
+#define LUT_ENTRY(i, ...) CURVE_AT(LUT_MIN_MV + (i) * LUT_STEP)
+
+static const uint16_t lut[LUT_SIZE] = { LISTIFY(LUT_SIZE, LUT_ENTRY, (,)) };
+
+#define RATE_WINDOW_MS (CONFIG_APP_SENS_FUEL_RATE_WINDOW_S * MSEC_PER_SEC)
+
+static struct {
+	uint16_t win[3];            //last raw readings, median input
+	int32_t ema_q4;             //filtered mV, 4 fractional bits
+	uint32_t ref_ms;            //rate window start
+	int32_t ref_pptt;           //filtered level at the window start
+	bool rate_valid;
+	struct sens_fuel_state out;
+} fg = { .out.tte_min = SENS_FUEL_TTE_UNKNOWN };
+
+static struct k_spinlock fg_lock;
+
+#ifdef CONFIG_APP_SENS_BACKEND_HW
+static struct k_poll_signal adc_done;
+static uint32_t start_cyc;
+static bool converting;
+#endif
+
+/* Level for a voltage, one table index and a linear interpolation */
+unsigned int sens_fuel_pptt(unsigned int batt_mV)
+{
+	unsigned int off, idx, span;
+
+	if (batt_mV >= CURVE_MV(0)) {
+		return CURVE_PPTT(0);
+	}
+	if (batt_mV <= LUT_MIN_MV) {
+		return lut[0];
+	}
+	off = batt_mV - LUT_MIN_MV;
+	idx = off / LUT_STEP;
+	/* the step is rounded up, the last entry may lie past the curve top */
+	span = MIN(LUT_STEP, CURVE_MV(0) - LUT_MIN_MV - idx * LUT_STEP);
+	return lut[idx] + (lut[idx + 1] - lut[idx]) * (off - idx * LUT_STEP) / span;
+}
+
+#ifdef CONFIG_APP_SENS_BACKEND_HW
+/*
+ * Begin a battery reading. In low power mode this only feeds the divider,
+ * the conversion starts in sens_fuel_read once it has settled, otherwise
+ * the conversion runs while the other sensors are fetched.
+ */
+int sens_fuel_start(void)
+{
+	int rc;
+
+	k_poll_signal_reset(&adc_done);
+	converting = false;
+	start_cyc = k_cycle_get_32();
+	if (IS_ENABLED(CONFIG_APP_SENS_LOW_POWER)) {
+		return battery_measure_enable(true);
+	}
+	rc = battery_sample_async(&adc_done);
+	converting = (rc == 0);
+	return rc;
+}
+
+/* Complete the reading begun by sens_fuel_start, returns mV or -errno */
+int sens_fuel_read(void)
+{
+	struct k_poll_event evt = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+							   K_POLL_MODE_NOTIFY_ONLY,
+							   &adc_done);
+	unsigned int signaled;
+	int result;
+	int rc = 0;
+
+#ifdef CONFIG_APP_SENS_LOW_POWER
+	uint32_t fed_us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cyc);
+
+	if (fed_us < CONFIG_APP_SENS_BATT_SETTLE_US) {
+		k_usleep(CONFIG_APP_SENS_BATT_SETTLE_US - fed_us);
+	}
+	rc = battery_sample_async(&adc_done);
+	converting = (rc == 0);
+#endif
+	if (!converting) {
+		/* start failed, nothing to collect */
+		rc = rc ? rc : -EIO;
+	} else {
+		rc = k_poll(&evt, 1, K_MSEC(CONFIG_APP_SENS_FUEL_TIMEOUT_MS));
+		k_poll_signal_check(&adc_done, &signaled, &result);
+		if (rc == 0) {
+			rc = signaled ? result : -EIO;
+		}
+		converting = false;
+	}
+	if (IS_ENABLED(CONFIG_APP_SENS_LOW_POWER)) {
+		battery_measure_enable(false);
+	}
+	return (rc == 0) ? battery_sample_result() : rc;
+}
+#endif /* CONFIG_APP_SENS_BACKEND_HW */
+
+static uint16_t median3(const uint16_t *w)
+{
+	uint16_t lo = MIN(w[0], w[1]);
+	uint16_t hi = MAX(w[0], w[1]);
+
+	return MAX(lo, MIN(hi, w[2]));
+}
+
+/* Fold one reading into the filter, level and rate estimate */
+void sens_fuel_update(int batt_mV, uint32_t now_ms)
+{
+	struct sens_fuel_state *out = &fg.out;
+	int32_t ema_mV, level;
+	k_spinlock_key_t key;
+
+	if (batt_mV < 0) {
+		return;
+	}
+
+	key = k_spin_lock(&fg_lock);
+	if (out->samples++ == 0) {
+		/* Seed everything with the first reading */
+		fg.win[0] = fg.win[1] = fg.win[2] = batt_mV;
+		fg.ema_q4 = batt_mV << 4;
+		out->mV = batt_mV;
+		fg.ref_ms = now_ms;
+		fg.ref_pptt = sens_fuel_pptt(batt_mV);
+	}
+	fg.win[out->samples % 3] = batt_mV;
+	fg.ema_q4 += ((median3(fg.win) << 4) - fg.ema_q4) /
+		     (1 << CONFIG_APP_SENS_FUEL_EMA_SHIFT);
+	ema_mV = fg.ema_q4 >> 4;
+
+	if (abs(ema_mV - out->mV) >= CONFIG_APP_SENS_FUEL_HYST_MV) {
+		out->mV = ema_mV;
+	}
+	out->pptt = sens_fuel_pptt(out->mV);
+
+	/* Rate from the unquantised filter output, once per window */
+	level = sens_fuel_pptt(ema_mV);
+	if (now_ms - fg.ref_ms >= RATE_WINDOW_MS) {
+		int32_t inst = (int64_t)(fg.ref_pptt - level) * 3600000 /
+			       (int32_t)(now_ms - fg.ref_ms);
+
+		out->rate_pptth = fg.rate_valid ? (out->rate_pptth * 3 + inst) / 4 : inst;
+		fg.rate_valid = true;
+		fg.ref_ms = now_ms;
+		fg.ref_pptt = level;
+	}
+	if (fg.rate_valid && out->rate_pptth > 0) {
+		out->tte_min = MIN((uint32_t)out->pptt * 60 / out->rate_pptth,
+				   SENS_FUEL_TTE_UNKNOWN - 1);
+	} else {
+		out->tte_min = SENS_FUEL_TTE_UNKNOWN;
+	}
+	k_spin_unlock(&fg_lock, key);
+
+	LOG_DBG("%d mV raw, %u mV, %u pptt, %d pptt/h, tte %u min", batt_mV,
+		out->mV, out->pptt, out->rate_pptth, out->tte_min);
+}
+
+void sens_fuel_get(struct sens_fuel_state *state)
+{
+	k_spinlock_key_t key = k_spin_lock(&fg_lock);
+
+	*state = fg.out;
+	k_spin_unlock(&fg_lock, key);
+}
+
+#ifdef CONFIG_APP_SENS_BACKEND_HW
+static int sens_fuel_init(const struct device *arg)
+{
+	ARG_UNUSED(arg);
+	k_poll_signal_init(&adc_done);
+	return 0;
+}
+
+SYS_INIT(sens_fuel_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+#endif
@@ -0,0 +1,33 @@
+/**
+ * @file sens_fuel.h
+ * @author Wilfred Mallawa
+ * @brief Battery fuel gauge, filtered voltage, level and time to empty.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_FUEL_H
+#define SENS_FUEL_H
+
+#include <stdint.h>
+
+#define SENS_FUEL_TTE_UNKNOWN UINT16_MAX    //not discharging, or no rate yet
+
+/* Gauge output */
+struct sens_fuel_state {
+    uint16_t mV;                //filtered, hysteresis applied
+    uint16_t pptt;              //remaining level, parts per ten thousand
+    int32_t rate_pptth;         //discharge rate in pptt per hour, < 0 charging
+    uint16_t tte_min;           //time to empty, minutes
+    uint32_t samples;
+};
+
+/* Function Declarations */
+extern int sens_fuel_start(void);
+extern int sens_fuel_read(void);
+extern void sens_fuel_update(int batt_mV, uint32_t now_ms);
+extern void sens_fuel_get(struct sens_fuel_state *state);
+extern unsigned int sens_fuel_pptt(unsigned int batt_mV);
+/* ---------------------- */
+
+#endif
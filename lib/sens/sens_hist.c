@@ -0,0 +1,373 @@
+/**
+ * @file sens_hist.c
+ * @author Wilfred Mallawa
+ * @brief Compressed time series of every published sensor packet.
+ *
+ *        The store is a ring of fixed size blocks. Each block opens with a
+ *        keyframe holding every channel, the following samples are encoded
+ *        as deltas against the previous one in a nibble stream:
+ *
+ *          mask   2 nibbles, bit n set when channel n changed (n < 7),
+ *                 bit 7 flags an extension nibble
+ *          ext    bit 0 sample interval changed, bit 1 battery changed,
+ *                 bit 2 valid mask changed
+ *          deltas zigzag varints, 3 data bits + 1 continuation bit each
+ *          valid  2 nibbles, the new SENS_VALID_* mask
+ *
+ *        Values are kept at display resolution so sensor noise below it
+ *        does not cost bits. When the ring is full the oldest block is
+ *        recycled whole.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include <zephyr/zephyr.h>
+
+#include "sens_hist.h"
+#include "sens_fuel.h"
+
+#define BLOCK_DATA  CONFIG_APP_SENS_HIST_BLOCK_SIZE
+#define NUM_BLOCKS  (CONFIG_APP_SENS_HIST_SIZE / CONFIG_APP_SENS_HIST_BLOCK_SIZE)
+#define TICK_MS     CONFIG_APP_SENS_HIST_TICK_MS
+#define CHAN_BATT   7
+/* Worst case record, mask + ext + 9 five-word varints + valid */
+#define REC_MAX_NIBBLES (2 + 1 + 9 * 11 + 2)
+
+BUILD_ASSERT(NUM_BLOCKS >= 2, "history needs at least two blocks");
+
+struct hist_block {
+	uint32_t t0;                    //keyframe tick
+	int32_t key[SENS_HIST_CHANS];   //keyframe values
+	uint8_t key_valid;              //keyframe SENS_VALID_* mask
+	uint16_t count;                 //samples, keyframe included
+	uint16_t nibbles;               //used nibbles of data
+	uint8_t data[BLOCK_DATA];
+};
+
+/* Quantisation step per channel, from packet units to history units */
+static const uint8_t chan_step[SENS_HIST_CHANS] = {
+	10,     //lps22hb_press, Pa -> 10 Pa
+	10,     //hts221_temp, centi -> deci celsius
+	10,     //hts221_rh, centi -> deci rh%
+	10,     //lps22hb_temp, centi -> deci celsius
+	10,     //xy_angle, centi -> deci degrees
+	1,      //ccs811_eco2, ppm
+	1,      //ccs811_etvoc, ppb
+	1,      //batt_mV
+};
+
+static struct hist_block blocks[NUM_BLOCKS];
+static uint32_t head;               //absolute number of the block being written
+static uint32_t dropped;
+static K_MUTEX_DEFINE(hist_lock);
+
+/* Encoder state */
+static int32_t last_val[SENS_HIST_CHANS];
+static uint8_t last_valid;
+static uint32_t last_tick;
+static uint32_t last_dt;
+
+static inline struct hist_block *block(uint32_t n)
+{
+	return &blocks[n % NUM_BLOCKS];
+}
+
+static inline uint32_t first_block(void)
+{
+	return (head >= NUM_BLOCKS) ? head - (NUM_BLOCKS - 1) : 0;
+}
+
+static void pkt_to_vals(const struct sens_packet *pkt, int32_t *val)
+{
+	val[0] = pkt->lps22hb_press;
+	val[1] = pkt->hts221_temp;
+	val[2] = pkt->hts221_rh;
+	val[3] = pkt->lps22hb_temp;
+	val[4] = pkt->xy_angle;
+	val[5] = pkt->ccs811_eco2;
+	val[6] = pkt->ccs811_etvoc;
+	val[7] = pkt->batt_mV;
+
+	for (int i = 0; i < SENS_HIST_CHANS; i++) {
+		val[i] /= chan_step[i];
+	}
+}
+
+static void vals_to_pkt(const int32_t *val, uint8_t valid, struct sens_packet *pkt)
+{
+	pkt->lps22hb_press = val[0] * chan_step[0];
+	pkt->hts221_temp = val[1] * chan_step[1];
+	pkt->hts221_rh = val[2] * chan_step[2];
+	pkt->lps22hb_temp = val[3] * chan_step[3];
+	pkt->xy_angle = val[4] * chan_step[4];
+	pkt->ccs811_eco2 = val[5] * chan_step[5];
+	pkt->ccs811_etvoc = val[6] * chan_step[6];
+	pkt->batt_mV = val[7] * chan_step[7];
+	/* derived battery values are not kept */
+	pkt->batt_pptt = 0;
+	pkt->batt_tte_min = SENS_FUEL_TTE_UNKNOWN;
+	pkt->version = SENS_PACKET_VERSION;
+	pkt->valid = valid;
+}
+
+/* Nibble stream helpers, low nibble first */
+static inline void put_nib(uint8_t *buf, uint16_t *pos, uint8_t nib)
+{
+	uint8_t *p = &buf[*pos >> 1];
+
+	if (*pos & 1) {
+		*p = (*p & 0x0f) | (nib << 4);
+	} else {
+		*p = nib & 0x0f;
+	}
+	(*pos)++;
+}
+
+static inline uint8_t get_nib(const uint8_t *buf, uint16_t *pos)
+{
+	uint8_t nib = buf[*pos >> 1];
+
+	nib = (*pos & 1) ? (nib >> 4) : (nib & 0x0f);
+	(*pos)++;
+	return nib;
+}
+
+static void put_varint(uint8_t *buf, uint16_t *pos, int32_t v)
+{
+	uint32_t z = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+
+	do {
+		uint8_t nib = z & 0x7;
+
+		z >>= 3;
+		put_nib(buf, pos, z ? (nib | 0x8) : nib);
+	} while (z);
+}
+
+static int32_t get_varint(const uint8_t *buf, uint16_t *pos)
+{
+	uint32_t z = 0;
+	unsigned int shift = 0;
+	uint8_t nib;
+
+	do {
+		nib = get_nib(buf, pos);
+		z |= (uint32_t)(nib & 0x7) << shift;
+		shift += 3;
+	} while (nib & 0x8);
+
+	return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+/* Start a new block with a keyframe, recycling the oldest one if needed */
+static void start_block(const int32_t *val, uint8_t valid, uint32_t tick)
+{
+	struct hist_block *blk;
+
+	if (block(head)->count != 0) {
+		head++;
+	}
+	blk = block(head);
+	if (head >= NUM_BLOCKS) {
+		dropped += blk->count;
+	}
+	blk->t0 = tick;
+	memcpy(blk->key, val, sizeof(blk->key));
+	blk->key_valid = valid;
+	blk->count = 1;
+	blk->nibbles = 0;
+}
+
+void sens_hist_append(const struct sens_packet *pkt, uint32_t now_ms)
+{
+	uint8_t rec[(REC_MAX_NIBBLES + 1) / 2];
+	int32_t val[SENS_HIST_CHANS];
+	uint32_t tick = now_ms / TICK_MS;
+	uint16_t len = 0;
+	struct hist_block *blk;
+	uint8_t mask = 0, ext = 0;
+	uint32_t dt;
+
+	pkt_to_vals(pkt, val);
+	k_mutex_lock(&hist_lock, K_FOREVER);
+	blk = block(head);
+
+	if (blk->count == 0) {
+		start_block(val, pkt->valid, tick);
+		goto out;
+	}
+
+	dt = tick - last_tick;
+	for (int i = 0; i < CHAN_BATT; i++) {
+		if (val[i] != last_val[i]) {
+			mask |= BIT(i);
+		}
+	}
+	if (dt != last_dt) {
+		ext |= BIT(0);
+	}
+	if (val[CHAN_BATT] != last_val[CHAN_BATT]) {
+		ext |= BIT(1);
+	}
+	if (pkt->valid != last_valid) {
+		ext |= BIT(2);
+	}
+	if (ext) {
+		mask |= BIT(7);
+	}
+
+	put_nib(rec, &len, mask & 0x0f);
+	put_nib(rec, &len, mask >> 4);
+	if (ext) {
+		put_nib(rec, &len, ext);
+	}
+	if (ext & BIT(0)) {
+		put_varint(rec, &len, dt - last_dt);
+	}
+	for (int i = 0; i < CHAN_BATT; i++) {
+		if (mask & BIT(i)) {
+			put_varint(rec, &len, val[i] - last_val[i]);
+		}
+	}
+	if (ext & BIT(1)) {
+		put_varint(rec, &len, val[CHAN_BATT] - last_val[CHAN_BATT]);
+	}
+	if (ext & BIT(2)) {
+		put_nib(rec, &len, pkt->valid & 0x0f);
+		put_nib(rec, &len, pkt->valid >> 4);
+	}
+
+	if (blk->nibbles + len > BLOCK_DATA * 2) {
+		start_block(val, pkt->valid, tick);
+		goto out;
+	}
+	for (uint16_t i = 0; i < len; i++) {
+		uint16_t src = i;
+
+		put_nib(blk->data, &blk->nibbles, get_nib(rec, &src));
+	}
+	blk->count++;
+	last_dt = dt;
+	last_tick = tick;
+	memcpy(last_val, val, sizeof(last_val));
+	last_valid = pkt->valid;
+	k_mutex_unlock(&hist_lock);
+	return;
+out:
+	/* a keyframe resets the delta state */
+	last_dt = 1;
+	last_tick = tick;
+	memcpy(last_val, val, sizeof(last_val));
+	last_valid = pkt->valid;
+	k_mutex_unlock(&hist_lock);
+}
+
+void sens_hist_iter_init(struct sens_hist_iter *it, uint32_t from_ms)
+{
+	uint32_t from = from_ms / TICK_MS;
+	uint32_t b;
+
+	k_mutex_lock(&hist_lock, K_FOREVER);
+	/* Last block that opens at or before from */
+	b = first_block();
+	while (b < head && block(b + 1)->t0 <= from) {
+		b++;
+	}
+	k_mutex_unlock(&hist_lock);
+
+	*it = (struct sens_hist_iter){ .block = b, .from = from };
+}
+
+/* Decode the next sample at or after the iterator start, -ENODATA at the end */
+int sens_hist_next(struct sens_hist_iter *it, struct sens_hist_sample *out)
+{
+	int rc = -ENODATA;
+
+	k_mutex_lock(&hist_lock, K_FOREVER);
+	while (1) {
+		const struct hist_block *blk;
+
+		if (it->block < first_block()) {
+			/* Overtaken by the writer, resume at the oldest block */
+			it->block = first_block();
+			it->idx = 0;
+			it->pos = 0;
+		}
+		blk = block(it->block);
+		if (it->idx >= blk->count) {
+			if (it->block >= head) {
+				break;
+			}
+			it->block++;
+			it->idx = 0;
+			it->pos = 0;
+			continue;
+		}
+
+		if (it->idx == 0) {
+			memcpy(it->val, blk->key, sizeof(it->val));
+			it->valid = blk->key_valid;
+			it->tick = blk->t0;
+			it->dt = 1;
+		} else {
+			uint8_t mask, ext = 0;
+
+			mask = get_nib(blk->data, &it->pos);
+			mask |= get_nib(blk->data, &it->pos) << 4;
+			if (mask & BIT(7)) {
+				ext = get_nib(blk->data, &it->pos);
+			}
+			if (ext & BIT(0)) {
+				it->dt += get_varint(blk->data, &it->pos);
+			}
+			for (int i = 0; i < CHAN_BATT; i++) {
+				if (mask & BIT(i)) {
+					it->val[i] += get_varint(blk->data, &it->pos);
+				}
+			}
+			if (ext & BIT(1)) {
+				it->val[CHAN_BATT] += get_varint(blk->data, &it->pos);
+			}
+			if (ext & BIT(2)) {
+				it->valid = get_nib(blk->data, &it->pos);
+				it->valid |= get_nib(blk->data, &it->pos) << 4;
+			}
+			it->tick += it->dt;
+		}
+		it->idx++;
+
+		if (it->tick >= it->from) {
+			out->t_ms = it->tick * TICK_MS;
+			vals_to_pkt(it->val, it->valid, &out->pkt);
+			rc = 0;
+			break;
+		}
+	}
+	k_mutex_unlock(&hist_lock);
+	return rc;
+}
+
+void sens_hist_stats_get(struct sens_hist_stats *stats)
+{
+	uint32_t first;
+
+	k_mutex_lock(&hist_lock, K_FOREVER);
+	first = first_block();
+	*stats = (struct sens_hist_stats){
+		.capacity = sizeof(blocks),
+		.dropped = dropped,
+		.oldest_ms = block(first)->t0 * TICK_MS,
+		.newest_ms = last_tick * TICK_MS,
+	};
+	for (uint32_t b = first; b <= head; b++) {
+		const struct hist_block *blk = block(b);
+
+		stats->samples += blk->count;
+		stats->bytes += offsetof(struct hist_block, data)
+				+ (blk->nibbles + 1) / 2;
+	}
+	k_mutex_unlock(&hist_lock);
+}
@@ -0,0 +1,53 @@
+/**
+ * @file sens_hist.h
+ * @author Wilfred Mallawa
+ * @brief In-RAM compressed history of published sensor packets.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_HIST_H
+#define SENS_HIST_H
+
+#include "sens.h"
+
+/* Channels kept in history, in encoding order */
+#define SENS_HIST_CHANS 8
+
+/* One decoded history entry */
+struct sens_hist_sample {
+    uint32_t t_ms;              //uptime at sample, history tick resolution
+    struct sens_packet pkt;     //values at history resolution and valid mask,
+                                //no battery level or time to empty
+};
+
+/* Decoder position, caller owned, no allocation */
+struct sens_hist_iter {
+    uint32_t block;             //absolute block number
+    uint16_t idx;               //sample index within block
+    uint16_t pos;               //nibble offset within block data
+    uint32_t from;              //first tick to report
+    uint32_t tick;
+    uint32_t dt;
+    int32_t val[SENS_HIST_CHANS];
+    uint8_t valid;              //SENS_VALID_* mask
+};
+
+/* Encoder statistics */
+struct sens_hist_stats {
+    uint32_t samples;           //samples currently retained
+    uint32_t bytes;             //bytes used by the retained samples
+    uint32_t capacity;          //total store size in bytes
+    uint32_t dropped;           //samples lost to block recycling
+    uint32_t oldest_ms;
+    uint32_t newest_ms;
+};
+
+/* Function Declarations */
+extern void sens_hist_append(const struct sens_packet *pkt, uint32_t now_ms);
+extern void sens_hist_iter_init(struct sens_hist_iter *it, uint32_t from_ms);
+extern int sens_hist_next(struct sens_hist_iter *it, struct sens_hist_sample *out);
+extern void sens_hist_stats_get(struct sens_hist_stats *stats);
+/* ---------------------- */
+
+#endif
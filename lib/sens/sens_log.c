@@ -0,0 +1,367 @@
+/**
+ * @file sens_log.c
+ * @author Wilfred Mallawa
+ * @brief Persistent sensor sample log. Samples are batched in RAM and
+ *        committed as one flash circular buffer (FCB) entry per batch, so
+ *        flash is programmed in large writes and a sector is only erased
+ *        when the log wraps over it. FCB CRCs every entry, after a power
+ *        loss a half written entry is skipped and the log carries on.
+ *        Flushes run on the system work queue, double buffered, so
+ *        sens_thread never waits on flash. Only the work queue commits,
+ *        sens_log_flush() swaps the buffers and waits for it.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/fcb.h>
+
+#include "sens_log.h"
+
+LOG_MODULE_REGISTER(sens_log, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define LOG_AREA_ID FLASH_AREA_ID(sens_log)
+#define LOG_MAGIC   0x534c4f47  //"SLOG"
+#define BATCH       CONFIG_APP_SENS_LOG_BATCH
+#define INTERVAL_MS (CONFIG_APP_SENS_LOG_INTERVAL_S * MSEC_PER_SEC)
+
+BUILD_ASSERT(BATCH <= UINT8_MAX, "batch count must fit the entry header");
+
+struct log_batch {
+	struct sens_log_hdr hdr;
+	struct sens_log_rec rec[BATCH];
+} __packed;
+
+static struct flash_sector log_sectors[CONFIG_APP_SENS_LOG_MAX_SECTORS];
+static struct fcb log_fcb;
+static bool log_ok;
+static uint16_t boot;
+
+/* Double buffer, sens_thread fills one while the other is flushed.
+ * batch_lock covers fill, the fill buffer and lost, flushing owns the
+ * other buffer until flush_handler is done with it.
+ */
+static struct log_batch batches[2];
+static uint8_t fill;
+static atomic_t flushing;
+static struct k_spinlock batch_lock;
+static struct k_work flush_work;
+static int flush_rc;
+static uint32_t lost;
+static uint32_t last_ms;
+static bool logged;
+static K_MUTEX_DEFINE(fcb_lock);
+
+static struct sens_log_stats stats;
+
+/* sens_log_walk copies records out of flash here, the callbacks run unlocked */
+static struct sens_log_rec walk_recs[BATCH];
+static K_MUTEX_DEFINE(walk_lock);
+
+/* FCB framing cost of an entry: length bytes, CRC byte, write alignment */
+static uint32_t entry_flash_bytes(uint16_t len)
+{
+	uint8_t align = flash_area_align(log_fcb.fap);
+	uint32_t hdr = (len < 0x80) ? 1 : 2;
+
+	return ROUND_UP(hdr, align) + ROUND_UP(len, align) + ROUND_UP(1, align);
+}
+
+/* Commit one batch as a single FCB entry, rotating out the oldest sector when full */
+static int log_commit(const struct log_batch *b)
+{
+	uint16_t len = sizeof(b->hdr) + b->hdr.count * sizeof(b->rec[0]);
+	struct fcb_entry loc;
+	int rc;
+
+	k_mutex_lock(&fcb_lock, K_FOREVER);
+	rc = fcb_append(&log_fcb, len, &loc);
+	if (rc == -ENOSPC) {
+		rc = fcb_rotate(&log_fcb);
+		if (rc == 0) {
+			stats.erases++;
+			rc = fcb_append(&log_fcb, len, &loc);
+		}
+	}
+	if (rc == 0) {
+		rc = flash_area_write(log_fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), b, len);
+	}
+	if (rc == 0) {
+		rc = fcb_append_finish(&log_fcb, &loc);
+	}
+	if (rc == 0) {
+		stats.samples += b->hdr.count;
+		stats.entries++;
+		stats.payload_bytes += b->hdr.count * sizeof(b->rec[0]);
+		stats.flash_bytes += entry_flash_bytes(len);
+	} else {
+		stats.dropped += b->hdr.count;
+		LOG_ERR("commit of %u records failed: %d", b->hdr.count, rc);
+	}
+	k_mutex_unlock(&fcb_lock);
+	return rc;
+}
+
+/* fill does not move while flushing is set, the other buffer is ours */
+static void flush_handler(struct k_work *work)
+{
+	struct log_batch *b = &batches[fill ^ 1];
+
+	ARG_UNUSED(work);
+	flush_rc = log_commit(b);
+	b->hdr.count = 0;
+	atomic_clear(&flushing);
+}
+
+/* Hand the fill buffer to the work queue, with batch_lock held */
+static bool batch_swap(void)
+{
+	if (!atomic_cas(&flushing, 0, 1)) {
+		return false;
+	}
+	fill ^= 1;
+	return true;
+}
+
+/* Record the highest boot number found in the log */
+static int boot_scan(struct fcb_entry_ctx *ctx, void *arg)
+{
+	struct sens_log_hdr hdr;
+	uint16_t *max = arg;
+
+	if (flash_area_read(ctx->fap, FCB_ENTRY_FA_DATA_OFF(ctx->loc),
+			    &hdr, sizeof(hdr)) == 0 && hdr.version == SENS_LOG_VERSION) {
+		*max = MAX(*max, hdr.boot);
+	}
+	return 0;
+}
+
+static int sens_log_init(const struct device *unused)
+{
+	uint32_t cnt = ARRAY_SIZE(log_sectors);
+	uint16_t last = 0;
+	int rc;
+
+	ARG_UNUSED(unused);
+	rc = flash_area_get_sectors(LOG_AREA_ID, &cnt, log_sectors);
+	if (rc != 0) {
+		LOG_ERR("no sens_log partition sectors: %d", rc);
+		return rc;
+	}
+
+	log_fcb.f_magic = LOG_MAGIC;
+	log_fcb.f_version = SENS_LOG_VERSION;
+	log_fcb.f_sector_cnt = cnt;
+	log_fcb.f_scratch_cnt = 0;
+	log_fcb.f_sectors = log_sectors;
+
+	rc = fcb_init(LOG_AREA_ID, &log_fcb);
+	if (rc != 0) {
+		/* Unrecognised or corrupt area, start over */
+		const struct flash_area *fa;
+
+		LOG_WRN("log area unusable (%d), erasing", rc);
+		rc = flash_area_open(LOG_AREA_ID, &fa);
+		if (rc == 0) {
+			rc = flash_area_erase(fa, 0, fa->fa_size);
+			flash_area_close(fa);
+		}
+		if (rc == 0) {
+			rc = fcb_init(LOG_AREA_ID, &log_fcb);
+		}
+		if (rc != 0) {
+			LOG_ERR("fcb init failed: %d", rc);
+			return rc;
+		}
+	}
+
+	fcb_walk(&log_fcb, NULL, boot_scan, &last);
+	boot = last + 1;
+	stats.boot = boot;
+	stats.sector_size = log_sectors[0].fs_size;
+	for (int i = 0; i < ARRAY_SIZE(batches); i++) {
+		batches[i].hdr.version = SENS_LOG_VERSION;
+		batches[i].hdr.boot = boot;
+	}
+	k_work_init(&flush_work, flush_handler);
+	log_ok = true;
+
+	LOG_INF("boot %u, %u sectors of %u bytes", boot, cnt, stats.sector_size);
+	return 0;
+}
+
+SYS_INIT(sens_log_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+void sens_log_append(const struct sens_packet *pkt, uint32_t now_ms)
+{
+	struct log_batch *b;
+	bool submit = false;
+	k_spinlock_key_t key;
+
+	if (!log_ok) {
+		return;
+	}
+	/* Decimate, one record per interval keeps the flash wear down */
+	if (logged && now_ms - last_ms < INTERVAL_MS) {
+		return;
+	}
+	logged = true;
+	last_ms = now_ms;
+
+	key = k_spin_lock(&batch_lock);
+	b = &batches[fill];
+	if (b->hdr.count == BATCH) {
+		/* Left full by a busy flush, retry the swap before losing anything */
+		if (!batch_swap()) {
+			lost++;
+			k_spin_unlock(&batch_lock, key);
+			return;
+		}
+		submit = true;
+		b = &batches[fill];
+	}
+	b->rec[b->hdr.count].t_ms = now_ms;
+	b->rec[b->hdr.count].pkt = *pkt;
+	b->hdr.count++;
+	/* Batch full, hand it to the work queue and switch buffers */
+	if (b->hdr.count == BATCH && batch_swap()) {
+		submit = true;
+	}
+	k_spin_unlock(&batch_lock, key);
+
+	if (submit) {
+		k_work_submit(&flush_work);
+	}
+}
+
+/* Commit the partial batch now, e.g. before a planned power down. The
+ * commit runs on the work queue like any other, a flush already in
+ * flight is waited for first.
+ */
+int sens_log_flush(void)
+{
+	struct k_work_sync sync;
+	k_spinlock_key_t key;
+	bool swapped;
+
+	if (!log_ok) {
+		return -ENODEV;
+	}
+	for (int tries = 0; tries < 2; tries++) {
+		key = k_spin_lock(&batch_lock);
+		if (batches[fill].hdr.count == 0) {
+			k_spin_unlock(&batch_lock, key);
+			k_work_flush(&flush_work, &sync);
+			return 0;
+		}
+		swapped = batch_swap();
+		k_spin_unlock(&batch_lock, key);
+
+		if (swapped) {
+			k_work_submit(&flush_work);
+		}
+		k_work_flush(&flush_work, &sync);
+		if (swapped) {
+			return flush_rc;
+		}
+	}
+	return -EBUSY;
+}
+
+/* Walk position, one entry at a time */
+struct walk_pos {
+	struct fcb_entry loc;
+	struct sens_log_hdr hdr;
+	uint8_t next;               //next record of the entry
+	uint32_t erase_at;          //stats.erases once the entry's sector is rotated out
+};
+
+/*
+ * Copy the next run of records, at most a batch, into walk_recs under
+ * fcb_lock. Returns the number copied, 0 at the end of the log. A commit
+ * may rotate the log between calls, when that takes the position's
+ * sector the walk carries on from the oldest entry, all newer than the
+ * records lost.
+ */
+static int walk_copy(struct walk_pos *pos)
+{
+	int n = 0;
+	int rc;
+
+	k_mutex_lock(&fcb_lock, K_FOREVER);
+	if (pos->loc.fe_sector != NULL && stats.erases >= pos->erase_at) {
+		pos->loc.fe_sector = NULL;
+		pos->next = pos->hdr.count = 0;
+	}
+	while (pos->next >= pos->hdr.count) {
+		if (fcb_getnext(&log_fcb, &pos->loc) != 0) {
+			goto out;
+		}
+		pos->next = 0;
+		rc = flash_area_read(log_fcb.fap, FCB_ENTRY_FA_DATA_OFF(pos->loc),
+				     &pos->hdr, sizeof(pos->hdr));
+		if (rc != 0 || pos->hdr.version != SENS_LOG_VERSION ||
+		    pos->loc.fe_data_len != sizeof(pos->hdr) +
+		    pos->hdr.count * sizeof(struct sens_log_rec)) {
+			/* Foreign or damaged entry, skip it */
+			pos->hdr.count = 0;
+		}
+	}
+	pos->erase_at = stats.erases + 1 +
+		(pos->loc.fe_sector - log_fcb.f_oldest + log_fcb.f_sector_cnt) %
+		log_fcb.f_sector_cnt;
+
+	n = MIN(pos->hdr.count - pos->next, BATCH);
+	rc = flash_area_read(log_fcb.fap, FCB_ENTRY_FA_DATA_OFF(pos->loc) + sizeof(pos->hdr) +
+			     pos->next * sizeof(walk_recs[0]), walk_recs, n * sizeof(walk_recs[0]));
+	if (rc != 0) {
+		n = rc;
+	} else {
+		pos->next += n;
+	}
+out:
+	k_mutex_unlock(&fcb_lock);
+	return n;
+}
+
+/* Walk every committed record, oldest first. The callback runs without
+ * fcb_lock, so a slow consumer such as the shell never holds up commits.
+ */
+int sens_log_walk(sens_log_cb_t cb, void *arg)
+{
+	struct walk_pos pos = { 0 };
+	int rc = 0;
+	int n;
+
+	if (!log_ok) {
+		return -ENODEV;
+	}
+	k_mutex_lock(&walk_lock, K_FOREVER);
+	while (rc == 0) {
+		n = walk_copy(&pos);
+		if (n <= 0) {
+			rc = n;
+			break;
+		}
+		for (int i = 0; i < n && rc == 0; i++) {
+			rc = cb(&walk_recs[i], pos.hdr.boot, arg);
+		}
+	}
+	k_mutex_unlock(&walk_lock);
+	return rc;
+}
+
+void sens_log_stats_get(struct sens_log_stats *out)
+{
+	k_spinlock_key_t key;
+
+	k_mutex_lock(&fcb_lock, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&fcb_lock);
+
+	key = k_spin_lock(&batch_lock);
+	out->dropped += lost;
+	k_spin_unlock(&batch_lock, key);
+}
@@ -0,0 +1,52 @@
+/**
+ * @file sens_log.h
+ * @author Wilfred Mallawa
+ * @brief Persistent sensor sample log on the sens_log flash partition.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_LOG_H
+#define SENS_LOG_H
+
+#include "sens.h"
+
+#define SENS_LOG_VERSION 2
+
+/* One logged sample */
+struct sens_log_rec {
+    uint32_t t_ms;              //uptime of the sample, within its boot
+    struct sens_packet pkt;
+} __packed;
+
+/* Header of every flash entry, followed by count records */
+struct sens_log_hdr {
+    uint8_t version;            //SENS_LOG_VERSION
+    uint8_t count;              //records in this entry
+    uint16_t boot;              //boot the records were taken in
+} __packed;
+
+/* Wear and throughput counters since boot */
+struct sens_log_stats {
+    uint32_t samples;           //records committed to flash
+    uint32_t entries;           //flash entries (batches) written
+    uint32_t payload_bytes;     //record bytes committed
+    uint32_t flash_bytes;       //bytes programmed, FCB framing included
+    uint32_t erases;            //sectors erased by rotation
+    uint32_t dropped;           //records lost to a busy or failed flush
+    uint32_t sector_size;
+    uint16_t boot;
+};
+
+/* Called for every record found by sens_log_walk, non-zero stops the walk */
+typedef int (*sens_log_cb_t)(const struct sens_log_rec *rec, uint16_t boot,
+                             void *arg);
+
+/* Function Declarations */
+extern void sens_log_append(const struct sens_packet *pkt, uint32_t now_ms);
+extern int sens_log_flush(void);
+extern int sens_log_walk(sens_log_cb_t cb, void *arg);
+extern void sens_log_stats_get(struct sens_log_stats *stats);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,180 @@
+/**
+ * @file sens_orient.c
+ * @author Wilfred Mallawa
+ * @brief Fixed-point orientation. atan2 and vector magnitude come from a
+ *        16 step CORDIC in vectoring mode, integer shifts and adds only,
+ *        so no soft-float libm on the Cortex-M4 without an FPU in use.
+ *        A CORDIC rather than CMSIS-DSP (CONFIG_CMSIS_DSP) keeps the code
+ *        to a few hundred bytes without its tables, and the error bound
+ *        in our hands.
+ *        The accelerometer vector is low-pass filtered before the angles
+ *        are taken, which smooths them without wrap-around artefacts.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/sys/util.h>
+
+#include "sens_orient.h"
+
+#define CORDIC_STEPS    16
+#define ANGLE_FRAC      256         //table and accumulator, 1/256 centi-degree
+#define CORDIC_GAIN_Q15 19898       //1 / prod(sqrt(1 + 2^-2i)), Q15
+#define NORM_BITS       28          //input scaled up to this, headroom for the gain
+
+/* atan(2^-i), centi-degrees * ANGLE_FRAC */
+static const int32_t atan_tab[CORDIC_STEPS] = {
+	1152000, 680065, 359328, 182400, 91554, 45822, 22916, 11459,
+	5730, 2865, 1432, 716, 358, 179, 90, 45,
+};
+
+static struct k_spinlock lock;
+static struct sens_orient out;
+static int32_t lpf[3];              //filtered vector, input units << LPF_FRAC
+
+#define LPF_FRAC        8
+
+/*
+ * Rotate (x, y) onto the positive x axis. Returns the angle rotated
+ * through in centi-degrees * ANGLE_FRAC, *px becomes the magnitude times
+ * the CORDIC gain, still scaled by the shift returned in *pshift.
+ */
+static int32_t cordic_vec(int32_t *px, int32_t y, int *pshift)
+{
+	int32_t x = *px;
+	int32_t angle = 0;
+	uint32_t m = MAX(abs(x), abs(y));
+	int shift = 0;
+
+	if (m == 0) {
+		*pshift = 0;
+		return 0;
+	}
+	/* Use the precision available, inputs are at most 31 bits */
+	while (m < BIT(NORM_BITS - 1)) {
+		m <<= 1;
+		shift++;
+	}
+	while (m >= BIT(NORM_BITS)) {
+		m >>= 1;
+		shift--;
+	}
+	x = (shift >= 0) ? x * (1 << shift) : x >> -shift;
+	y = (shift >= 0) ? y * (1 << shift) : y >> -shift;
+
+	/* Left half plane, start from a half turn */
+	if (x < 0) {
+		angle = (y >= 0) ? 18000 * ANGLE_FRAC : -18000 * ANGLE_FRAC;
+		x = -x;
+		y = -y;
+	}
+	for (int i = 0; i < CORDIC_STEPS; i++) {
+		int32_t dx = y >> i;
+		int32_t dy = x >> i;
+
+		if (y > 0) {
+			x += dx;
+			y -= dy;
+			angle += atan_tab[i];
+		} else {
+			x -= dx;
+			y += dy;
+			angle -= atan_tab[i];
+		}
+	}
+	*px = x;
+	*pshift = shift;
+	return angle;
+}
+
+/* atan2(y, x) in centi-degrees, -18000..18000 */
+int16_t sens_atan2(int32_t y, int32_t x)
+{
+	int shift;
+	int32_t angle = cordic_vec(&x, y, &shift);
+
+	return (angle + (angle >= 0 ? ANGLE_FRAC / 2 : -ANGLE_FRAC / 2)) / ANGLE_FRAC;
+}
+
+/* sqrt(a^2 + b^2) without a square root, the result must fit in 31 bits */
+int32_t sens_vec_mag(int32_t a, int32_t b)
+{
+	int shift;
+	int64_t m;
+
+	cordic_vec(&a, b, &shift);
+	m = ((int64_t)a * CORDIC_GAIN_Q15) >> 15;
+	if (shift <= 0) {
+		return m << -shift;
+	}
+	return (m + BIT(shift - 1)) >> shift;
+}
+
+/*
+ * x/y tilt in centi-degrees, atan(x / y) with y < 0 folded onto the
+ * right half plane. The axes are in any one unit, only their ratio
+ * counts. y == 0 lies on the +-90 degree asymptote, except x == y == 0,
+ * a vector along z, which has no x/y tilt and gives 0.
+ */
+int16_t sens_tilt_xy(int32_t x, int32_t y)
+{
+	if (y == 0) {
+		return (x == 0) ? 0 : (x < 0) ? -9000 : 9000;
+	}
+	return (y > 0) ? sens_atan2(x, y) : sens_atan2(-x, -y);
+}
+
+/*
+ * Fold one accelerometer sample into the filtered vector and update the
+ * angles. Any unit works, only the direction matters.
+ */
+void sens_orient_update(int32_t x, int32_t y, int32_t z)
+{
+	const int32_t in[3] = { x, y, z };
+	struct sens_orient o;
+	k_spinlock_key_t key;
+	int32_t fx, fy, fz;
+
+	for (int a = 0; a < 3; a++) {
+		int32_t v = in[a] * (1 << LPF_FRAC);
+
+		if (out.samples == 0) {
+			lpf[a] = v;
+		} else {
+			lpf[a] += (v - lpf[a]) / (1 << CONFIG_APP_SENS_ORIENT_LPF_SHIFT);
+		}
+	}
+	fx = lpf[0];
+	fy = lpf[1];
+	fz = lpf[2];
+
+	o.pitch = sens_atan2(-fx, sens_vec_mag(fy, fz));
+	o.roll = sens_atan2(fy, fz);
+	o.tilt = sens_atan2(sens_vec_mag(fx, fy), fz);
+	o.xy = sens_tilt_xy(fx, fy);
+
+	key = k_spin_lock(&lock);
+	o.samples = out.samples + 1;
+	out = o;
+	k_spin_unlock(&lock, key);
+}
+
+/* Forget the filtered vector, the next sample seeds it */
+void sens_orient_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	out = (struct sens_orient){ 0 };
+	k_spin_unlock(&lock, key);
+}
+
+void sens_orient_get(struct sens_orient *orient)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*orient = out;
+	k_spin_unlock(&lock, key);
+}
@@ -0,0 +1,33 @@
+/**
+ * @file sens_orient.h
+ * @author Wilfred Mallawa
+ * @brief Fixed-point orientation from the accelerometer, pitch, roll and
+ *        tilt from vertical, smoothed across samples.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_ORIENT_H
+#define SENS_ORIENT_H
+
+#include <stdint.h>
+
+/* Orientation of the smoothed gravity vector, centi-degrees */
+struct sens_orient {
+    int16_t pitch;          //about y, nose up positive, -9000..9000
+    int16_t roll;           //about x, -18000..18000
+    int16_t tilt;           //z axis from vertical, 0..18000
+    int16_t xy;             //x/y tilt as sens_tilt_xy, -9000..9000
+    uint32_t samples;
+};
+
+/* Function Declarations */
+extern int16_t sens_atan2(int32_t y, int32_t x);
+extern int32_t sens_vec_mag(int32_t a, int32_t b);
+extern int16_t sens_tilt_xy(int32_t x, int32_t y);
+extern void sens_orient_update(int32_t x, int32_t y, int32_t z);
+extern void sens_orient_reset(void);
+extern void sens_orient_get(struct sens_orient *orient);
+/* ---------------------- */
+
+#endif
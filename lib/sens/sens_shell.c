@@ -0,0 +1,405 @@
+/**
+ * @file sens_shell.c
+ * @author Wilfred Mallawa
+ * @brief "sens" shell command group, inspection of the sensor pipeline.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/zephyr.h>
+#include <zephyr/shell/shell.h>
+
+#include "sens.h"
+#include "sens_hist.h"
+#include "sens_log.h"
+#include "sens_stats.h"
+#include "sens_accel.h"
+#include "sens_adapt.h"
+#include "sens_ccs811.h"
+#include "sens_orient.h"
+#include "sens_filt.h"
+#include "sens_telem.h"
+
+#define PKT_CSV_HDR "temp_c,rh,press_pa,temp2_c,angle_deg,eco2_ppm,etvoc_ppb,batt_mv,batt_pct,tte_min"
+
+/* Print one packet as a CSV row, after the given prefix columns */
+static void __unused pkt_print(const struct shell *sh, const char *prefix,
+			       const struct sens_packet *p)
+{
+	shell_print(sh, "%s%s%d.%02d,%s%d.%02d,%u,%s%d.%02d,%s%d.%02d,%u,%u,%u,%u.%02u,%u",
+		    prefix, SENS_CENTI_ARGS(p->hts221_temp),
+		    SENS_CENTI_ARGS(p->hts221_rh), p->lps22hb_press,
+		    SENS_CENTI_ARGS(p->lps22hb_temp), SENS_CENTI_ARGS(p->xy_angle),
+		    p->ccs811_eco2, p->ccs811_etvoc, p->batt_mV,
+		    p->batt_pptt / 100, p->batt_pptt % 100, p->batt_tte_min);
+}
+
+#ifdef CONFIG_APP_SENS_HIST
+/* Print one history sample as a CSV row */
+static void hist_print(const struct shell *sh, const struct sens_hist_sample *s)
+{
+	char prefix[12];
+
+	snprintk(prefix, sizeof(prefix), "%u,", s->t_ms);
+	pkt_print(sh, prefix, &s->pkt);
+}
+
+/* sens history [from_s] [count] */
+static int cmd_hist(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_hist_sample chunk[CONFIG_APP_SENS_HIST_CHUNK];
+	struct sens_hist_iter it;
+	uint32_t from_ms = (argc > 1) ? strtoul(argv[1], NULL, 0) * MSEC_PER_SEC : 0;
+	uint32_t left = (argc > 2) ? strtoul(argv[2], NULL, 0) : UINT32_MAX;
+	size_t n;
+
+	shell_print(sh, "t_ms," PKT_CSV_HDR);
+	sens_hist_iter_init(&it, from_ms);
+	do {
+		/* Decode a chunk, then print it with the store unlocked */
+		for (n = 0; n < ARRAY_SIZE(chunk) && left > 0; n++, left--) {
+			if (sens_hist_next(&it, &chunk[n]) != 0) {
+				left = 0;
+				break;
+			}
+		}
+		for (size_t i = 0; i < n; i++) {
+			hist_print(sh, &chunk[i]);
+		}
+	} while (left > 0);
+
+	return 0;
+}
+
+/* sens history stats */
+static int cmd_hist_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_hist_stats st;
+	struct sens_hist_sample s;
+	struct sens_hist_iter it;
+	uint32_t decoded = 0;
+	uint32_t start, us;
+
+	sens_hist_stats_get(&st);
+
+	/* Decode throughput over everything retained */
+	sens_hist_iter_init(&it, 0);
+	start = k_cycle_get_32();
+	while (sens_hist_next(&it, &s) == 0) {
+		decoded++;
+	}
+	us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+	shell_print(sh, "samples:   %u (%u dropped)", st.samples, st.dropped);
+	shell_print(sh, "span:      %u..%u ms", st.oldest_ms, st.newest_ms);
+	shell_print(sh, "store:     %u of %u bytes", st.bytes, st.capacity);
+	if (st.samples) {
+		uint32_t centi = st.bytes * 100 / st.samples;
+
+		shell_print(sh, "per sample: %u.%02u bytes (packet %u)",
+			    centi / 100, centi % 100,
+			    (unsigned int)sizeof(struct sens_packet));
+	}
+	shell_print(sh, "decode:    %u samples in %u us (%u samples/s)", decoded, us,
+		    us ? (uint32_t)((uint64_t)decoded * USEC_PER_SEC / us) : 0);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_hist,
+	SHELL_CMD(stats, NULL, "Store usage, bytes per sample, decode rate",
+		  cmd_hist_stats),
+	SHELL_SUBCMD_SET_END
+);
+#endif /* CONFIG_APP_SENS_HIST */
+
+#ifdef CONFIG_APP_SENS_STATS
+/* sens stats */
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "chan  win  count        min        max       mean     stddev");
+	for (int c = 0; c < SENS_STAT_CHAN_COUNT; c++) {
+		for (int w = 0; w < SENS_STAT_WIN_COUNT; w++) {
+			struct sens_stat st;
+
+			sens_stats_get(c, w, &st);
+			shell_print(sh, "%-5s %-4s %5u %10d %10d %10d %10d",
+				    sens_stat_chan_name(c), sens_stat_win_name(w),
+				    st.count, st.min, st.max, st.mean, st.stddev);
+		}
+	}
+	return 0;
+}
+#endif /* CONFIG_APP_SENS_STATS */
+
+#ifdef CONFIG_APP_SENS_LOG
+struct log_dump {
+	const struct shell *sh;
+	uint32_t left;
+};
+
+static int log_print(const struct sens_log_rec *rec, uint16_t boot, void *arg)
+{
+	struct log_dump *d = arg;
+	char prefix[20];
+
+	if (d->left == 0) {
+		return 1;
+	}
+	d->left--;
+	snprintk(prefix, sizeof(prefix), "%u,%u,", boot, rec->t_ms);
+	pkt_print(d->sh, prefix, &rec->pkt);
+	return 0;
+}
+
+/* sens log [count] */
+static int cmd_log(const struct shell *sh, size_t argc, char **argv)
+{
+	struct log_dump d = {
+		.sh = sh,
+		.left = (argc > 1) ? strtoul(argv[1], NULL, 0) : UINT32_MAX,
+	};
+	int rc;
+
+	shell_print(sh, "boot,t_ms," PKT_CSV_HDR);
+	rc = sens_log_walk(log_print, &d);
+	return (rc < 0) ? rc : 0;
+}
+
+/* sens log flush */
+static int cmd_log_flush(const struct shell *sh, size_t argc, char **argv)
+{
+	int rc = sens_log_flush();
+
+	if (rc != 0) {
+		shell_error(sh, "flush failed: %d", rc);
+	}
+	return rc;
+}
+
+/* sens log stats */
+static int cmd_log_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_log_stats st;
+
+	sens_log_stats_get(&st);
+	shell_print(sh, "boot:      %u", st.boot);
+	shell_print(sh, "samples:   %u in %u entries (%u dropped)",
+		    st.samples, st.entries, st.dropped);
+	shell_print(sh, "flash:     %u bytes for %u payload, %u erases",
+		    st.flash_bytes, st.payload_bytes, st.erases);
+	if (st.payload_bytes) {
+		uint32_t wa = st.flash_bytes * 100 / st.payload_bytes;
+
+		shell_print(sh, "write amp: %u.%02u", wa / 100, wa % 100);
+	}
+	if (st.erases) {
+		shell_print(sh, "samples/erase: %u", st.samples / st.erases);
+	} else if (st.flash_bytes) {
+		/* No wrap yet, project from the bytes per sample so far */
+		shell_print(sh, "samples/erase: ~%u (projected)",
+			    (uint32_t)((uint64_t)st.sector_size * st.samples / st.flash_bytes));
+	}
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_log,
+	SHELL_CMD(flush, NULL, "Commit the pending batch to flash", cmd_log_flush),
+	SHELL_CMD(stats, NULL, "Write amplification and wear counters",
+		  cmd_log_stats),
+	SHELL_SUBCMD_SET_END
+);
+#endif /* CONFIG_APP_SENS_LOG */
+
+static int cmd_power(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_power_stats ps;
+
+	sens_power_stats_get(&ps);
+	shell_print(sh, "cycle:     %u nC over %u ms", ps.cycle_nC, ps.interval_ms);
+	shell_print(sh, "average:   %u uA", ps.avg_uA);
+	shell_print(sh, "total:     %u uC", (uint32_t)(ps.total_nC / 1000U));
+	for (int i = 0; i < SENS_SRC_COUNT; i++) {
+		if (!sens_src_present(i)) {
+			continue;
+		}
+#ifdef CONFIG_APP_SENS_ADAPT
+		shell_print(sh, "%-10s %-9s %6u ms, %u ramp ups", sens_src_name(i),
+			    (ps.suspended & BIT(i)) ? "suspended" : "running",
+			    sens_sched_period_get(i), sens_adapt_ramps_get(i));
+#else
+		shell_print(sh, "%-10s %-9s %6u ms", sens_src_name(i),
+			    (ps.suspended & BIT(i)) ? "suspended" : "running",
+			    sens_sched_period_get(i));
+#endif
+	}
+	return 0;
+}
+
+/* sens trace [every], summary log rate plus the per cycle logging cost */
+static int cmd_trace(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_acq_stats st;
+
+	if (argc > 1) {
+		sens_trace_set(strtoul(argv[1], NULL, 0));
+	}
+	sens_acq_stats_get(&st);
+	shell_print(sh, "summary:   every %u cycles (0 = off)", sens_trace_get());
+	shell_print(sh, "process:   %u cycles (%u us)", st.process_cyc,
+		    k_cyc_to_us_floor32(st.process_cyc));
+	shell_print(sh, "rtt:       %u bytes last interval", st.rtt_bytes);
+	return 0;
+}
+
+#ifdef CONFIG_APP_SENS_LIS2DH
+static int cmd_orient(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_orient o;
+
+	sens_orient_get(&o);
+	if (o.samples == 0) {
+		shell_print(sh, "no accelerometer samples yet");
+		return 0;
+	}
+	shell_print(sh, "pitch:     %s%d.%02d deg", SENS_CENTI_ARGS(o.pitch));
+	shell_print(sh, "roll:      %s%d.%02d deg", SENS_CENTI_ARGS(o.roll));
+	shell_print(sh, "tilt:      %s%d.%02d deg", SENS_CENTI_ARGS(o.tilt));
+	shell_print(sh, "xy:        %s%d.%02d deg", SENS_CENTI_ARGS(o.xy));
+	shell_print(sh, "samples:   %u", o.samples);
+	return 0;
+}
+#endif /* CONFIG_APP_SENS_LIS2DH */
+
+#ifdef CONFIG_APP_SENS_FILT
+static int cmd_filter(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_filt_cost cost;
+
+	for (int c = 0; c < SENS_FILT_CHAN_COUNT; c++) {
+		uint32_t stages = sens_filt_stages(c);
+		char line[48] = "";
+
+		for (int s = 0; s < SENS_FILT_STAGE_COUNT; s++) {
+			if (stages & BIT(s)) {
+				strncat(line, " ", sizeof(line) - strlen(line) - 1);
+				strncat(line, sens_filt_stage_name(s),
+					sizeof(line) - strlen(line) - 1);
+			}
+		}
+		shell_print(sh, "%-9s %s", sens_filt_chan_name(c),
+			    stages ? line + 1 : "raw");
+	}
+	shell_print(sh, "stage,calls,avg_cyc,max_cyc,avg_ns");
+	for (int s = 0; s < SENS_FILT_STAGE_COUNT; s++) {
+		uint32_t avg;
+
+		sens_filt_cost_get(s, &cost);
+		if (cost.calls == 0) {
+			continue;
+		}
+		avg = cost.total_cyc / cost.calls;
+		shell_print(sh, "%s,%u,%u,%u,%u", sens_filt_stage_name(s),
+			    cost.calls, avg, cost.max_cyc,
+			    (uint32_t)k_cyc_to_ns_floor64(avg));
+	}
+	return 0;
+}
+
+#endif /* CONFIG_APP_SENS_FILT */
+#ifdef CONFIG_APP_SENS_TELEM
+static int cmd_telem(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_telem_stats st;
+
+	sens_telem_stats_get(&st);
+	shell_print(sh, "frames:    %u, %u records", st.frames, st.records);
+	shell_print(sh, "bytes:     %u", st.bytes);
+	if (st.records) {
+		shell_print(sh, "per record: %u bytes (packet %u)", st.bytes / st.records,
+			    (unsigned int)sizeof(struct sens_packet));
+	}
+	shell_print(sh, "dropped:   %u packets, %u frames not sent", st.dropped,
+		    st.write_errors);
+	return 0;
+}
+
+#endif /* CONFIG_APP_SENS_TELEM */
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+static int cmd_accel(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_accel_stats st;
+
+	sens_accel_stats_get(&st);
+	shell_print(sh, "rate:      %u Hz, %u samples", st.odr_hz, st.samples);
+	shell_print(sh, "batches:   %u in %u wakeups, %u overrun", st.batches,
+		    st.wakeups, st.overruns);
+	shell_print(sh, "i2c:       %u transfers", st.i2c_xfers);
+	if (st.batches) {
+		shell_print(sh, "per batch: %u samples", st.samples / st.batches);
+	}
+	shell_print(sh, "knocks:    %u, last peak %u mg", st.knocks, st.peak_mg);
+	return 0;
+}
+
+#endif /* CONFIG_APP_SENS_ACCEL_FIFO */
+#if defined(CONFIG_APP_SENS_BACKEND_HW) && defined(CONFIG_APP_SENS_CCS811)
+static int cmd_ccs811(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sens_ccs811_stats st;
+
+	sens_ccs811_stats_get(&st);
+	if (st.baseline < 0) {
+		shell_print(sh, "baseline:  not read yet");
+	} else {
+		shell_print(sh, "baseline:  %04x%s", st.baseline,
+			    st.restored ? " (restored)" : "");
+	}
+	shell_print(sh, "saved:     %u times", st.saves);
+	if (st.env_updates) {
+		shell_print(sh, "envdata:   %s%d.%02d C %d.%02d %%RH, %u writes",
+			    SENS_CENTI_ARGS(st.env_temp), st.env_rh / 100,
+			    st.env_rh % 100, st.env_updates);
+	}
+	return 0;
+}
+
+#endif /* CONFIG_APP_SENS_BACKEND_HW && CONFIG_APP_SENS_CCS811 */
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_sens,
+#ifdef CONFIG_APP_SENS_HIST
+	SHELL_CMD_ARG(history, &sub_hist,
+		      "Dump history as CSV: history [from_s] [count]",
+		      cmd_hist, 1, 2),
+#endif
+#ifdef CONFIG_APP_SENS_STATS
+	SHELL_CMD(stats, NULL, "Window statistics, in packet units", cmd_stats),
+#endif
+#ifdef CONFIG_APP_SENS_LOG
+	SHELL_CMD_ARG(log, &sub_log, "Dump flash log as CSV: log [count]",
+		      cmd_log, 1, 1),
+#endif
+	SHELL_CMD(power, NULL, "Modelled charge and period per source", cmd_power),
+#ifdef CONFIG_APP_SENS_LIS2DH
+	SHELL_CMD(orient, NULL, "Smoothed pitch, roll and tilt", cmd_orient),
+#endif
+#ifdef CONFIG_APP_SENS_TELEM
+	SHELL_CMD(telem, NULL, "Telemetry frame and drop counters", cmd_telem),
+#endif
+#ifdef CONFIG_APP_SENS_FILT
+	SHELL_CMD(filter, NULL, "Filter stages per channel and their cost", cmd_filter),
+#endif
+#if defined(CONFIG_APP_SENS_BACKEND_HW) && defined(CONFIG_APP_SENS_CCS811)
+	SHELL_CMD(ccs811, NULL, "CCS811 baseline and compensation", cmd_ccs811),
+#endif
+#ifdef CONFIG_APP_SENS_ACCEL_FIFO
+	SHELL_CMD(accel, NULL, "Accelerometer FIFO batch counters", cmd_accel),
+#endif
+	SHELL_CMD_ARG(trace, NULL, "Summary log rate and logging cost: trace [every]",
+		      cmd_trace, 1, 1),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(sens, &sub_sens, "Sensor pipeline commands", NULL);
@@ -0,0 +1,280 @@
+/**
+ * @file sens_stats.c
+ * @author Wilfred Mallawa
+ * @brief Sliding window statistics. Each window is split into a ring of
+ *        buckets. A sample is folded into the open bucket and the window
+ *        running sums, when a bucket expires its sums are subtracted
+ *        again, so the cost per sample does not depend on window length.
+ *        Min/max come from monotonic deques of closed buckets plus the
+ *        open one. Sums are kept relative to the first value seen per
+ *        channel so the squares stay well within 64 bits over 24 h.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <zephyr/zephyr.h>
+
+#include "sens_stats.h"
+
+#define BUCKETS CONFIG_APP_SENS_STATS_BUCKETS
+
+struct bucket {
+	int32_t min;
+	int32_t max;
+	int32_t sum;
+	uint32_t count;
+	int64_t sumsq;
+};
+
+/* Monotonic deque of bucket sequence numbers */
+struct mdeque {
+	uint32_t seq[BUCKETS];
+	uint8_t head;
+	uint8_t len;
+};
+
+struct window {
+	struct bucket b[BUCKETS];
+	struct mdeque dmin;
+	struct mdeque dmax;
+	int64_t sum;
+	int64_t sumsq;
+	uint32_t count;
+};
+
+struct chan_stats {
+	struct window win[SENS_STAT_WIN_COUNT];
+	int32_t ref;            //offset all sums are taken against
+	bool ref_set;
+};
+
+/* Bucket length per window */
+static const uint32_t bucket_ms[SENS_STAT_WIN_COUNT] = {
+	60U * MSEC_PER_SEC / BUCKETS,
+	3600U * MSEC_PER_SEC / BUCKETS,
+	86400U * MSEC_PER_SEC / BUCKETS,
+};
+
+static const char *const chan_names[SENS_STAT_CHAN_COUNT] = {
+	"temp", "rh", "press", "eco2", "etvoc",
+};
+
+static const char *const win_names[SENS_STAT_WIN_COUNT] = {
+	"1m", "1h", "24h",
+};
+
+static struct chan_stats chans[SENS_STAT_CHAN_COUNT];
+/* Sequence number of the open bucket, shared by all channels */
+static uint32_t cur_seq[SENS_STAT_WIN_COUNT];
+static bool started;
+static struct k_spinlock stats_lock;
+
+static inline void bucket_reset(struct bucket *b)
+{
+	*b = (struct bucket){ .min = INT32_MAX, .max = INT32_MIN };
+}
+
+/* Push a closed bucket, dropping dominated entries from the back */
+static void mdeque_push(struct mdeque *d, const struct window *win,
+			uint32_t seq, bool is_min)
+{
+	const struct bucket *b = &win->b[seq % BUCKETS];
+
+	while (d->len > 0) {
+		const struct bucket *back =
+			&win->b[d->seq[(d->head + d->len - 1) % BUCKETS] % BUCKETS];
+
+		if (is_min ? (back->min < b->min) : (back->max > b->max)) {
+			break;
+		}
+		d->len--;
+	}
+	d->seq[(d->head + d->len) % BUCKETS] = seq;
+	d->len++;
+}
+
+/* Drop deque entries older than the oldest bucket still in the window */
+static void mdeque_expire(struct mdeque *d, uint32_t oldest)
+{
+	while (d->len > 0 && (int32_t)(d->seq[d->head] - oldest) < 0) {
+		d->head = (d->head + 1) % BUCKETS;
+		d->len--;
+	}
+}
+
+static void window_reset(struct window *win)
+{
+	for (int i = 0; i < BUCKETS; i++) {
+		bucket_reset(&win->b[i]);
+	}
+	win->dmin.len = 0;
+	win->dmax.len = 0;
+	win->sum = 0;
+	win->sumsq = 0;
+	win->count = 0;
+}
+
+/* Close bucket seq and open seq + 1, recycling the slot it shares */
+static void window_advance(struct window *win, uint32_t seq)
+{
+	struct bucket *next = &win->b[(seq + 1) % BUCKETS];
+
+	if (win->b[seq % BUCKETS].count > 0) {
+		mdeque_push(&win->dmin, win, seq, true);
+		mdeque_push(&win->dmax, win, seq, false);
+	}
+	mdeque_expire(&win->dmin, seq + 2 - BUCKETS);
+	mdeque_expire(&win->dmax, seq + 2 - BUCKETS);
+	win->sum -= next->sum;
+	win->sumsq -= next->sumsq;
+	win->count -= next->count;
+	bucket_reset(next);
+}
+
+static void window_add(struct window *win, uint32_t seq, int32_t v)
+{
+	struct bucket *b = &win->b[seq % BUCKETS];
+
+	b->min = MIN(b->min, v);
+	b->max = MAX(b->max, v);
+	b->sum += v;
+	b->sumsq += (int64_t)v * v;
+	b->count++;
+	win->sum += v;
+	win->sumsq += (int64_t)v * v;
+	win->count++;
+}
+
+static void chan_add(struct chan_stats *cs, int32_t v)
+{
+	if (!cs->ref_set) {
+		cs->ref = v;
+		cs->ref_set = true;
+	}
+	for (int w = 0; w < SENS_STAT_WIN_COUNT; w++) {
+		window_add(&cs->win[w], cur_seq[w], v - cs->ref);
+	}
+}
+
+static void stats_init(void)
+{
+	for (int c = 0; c < SENS_STAT_CHAN_COUNT; c++) {
+		for (int w = 0; w < SENS_STAT_WIN_COUNT; w++) {
+			window_reset(&chans[c].win[w]);
+		}
+	}
+	started = true;
+}
+
+void sens_stats_update(const struct sens_packet *pkt, uint32_t now_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	if (!started) {
+		stats_init();
+	}
+
+	/* Catch every window up to now, a gap longer than the window empties it */
+	for (int w = 0; w < SENS_STAT_WIN_COUNT; w++) {
+		uint32_t seq = now_ms / bucket_ms[w];
+
+		for (int c = 0; c < SENS_STAT_CHAN_COUNT; c++) {
+			struct window *win = &chans[c].win[w];
+
+			if (seq - cur_seq[w] >= BUCKETS) {
+				window_reset(win);
+				continue;
+			}
+			for (uint32_t s = cur_seq[w]; s != seq; s++) {
+				window_advance(win, s);
+			}
+		}
+		cur_seq[w] = seq;
+	}
+
+	if (pkt->valid & SENS_VALID_HTS221) {
+		chan_add(&chans[SENS_STAT_TEMP], pkt->hts221_temp);
+		chan_add(&chans[SENS_STAT_RH], pkt->hts221_rh);
+	}
+	if (pkt->valid & SENS_VALID_LPS22HB) {
+		chan_add(&chans[SENS_STAT_PRESS], pkt->lps22hb_press);
+	}
+	if (pkt->valid & SENS_VALID_CCS811) {
+		chan_add(&chans[SENS_STAT_ECO2], pkt->ccs811_eco2);
+		chan_add(&chans[SENS_STAT_ETVOC], pkt->ccs811_etvoc);
+	}
+	k_spin_unlock(&stats_lock, key);
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+	uint64_t res = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (v >= res + bit) {
+			v -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)res;
+}
+
+int sens_stats_get(enum sens_stat_chan chan, enum sens_stat_win win,
+		   struct sens_stat *out)
+{
+	const struct chan_stats *cs;
+	const struct window *wp;
+	const struct bucket *open;
+	int32_t min, max;
+	k_spinlock_key_t key;
+
+	if (chan >= SENS_STAT_CHAN_COUNT || win >= SENS_STAT_WIN_COUNT) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&stats_lock);
+	cs = &chans[chan];
+	wp = &cs->win[win];
+	*out = (struct sens_stat){ .count = wp->count };
+	if (wp->count == 0) {
+		k_spin_unlock(&stats_lock, key);
+		return 0;
+	}
+
+	open = &wp->b[cur_seq[win] % BUCKETS];
+	min = open->min;
+	max = open->max;
+	if (wp->dmin.len > 0) {
+		min = MIN(min, wp->b[wp->dmin.seq[wp->dmin.head] % BUCKETS].min);
+	}
+	if (wp->dmax.len > 0) {
+		max = MAX(max, wp->b[wp->dmax.seq[wp->dmax.head] % BUCKETS].max);
+	}
+
+	out->min = cs->ref + min;
+	out->max = cs->ref + max;
+	out->mean = cs->ref + (int32_t)(wp->sum / (int64_t)wp->count);
+	/* var = (sumsq - sum^2 / n) / n, in relative units */
+	out->stddev = isqrt64((uint64_t)MAX(0, (wp->sumsq - wp->sum * wp->sum /
+					      (int64_t)wp->count) / (int64_t)wp->count));
+	k_spin_unlock(&stats_lock, key);
+
+	return 0;
+}
+
+const char *sens_stat_chan_name(enum sens_stat_chan chan)
+{
+	return (chan < SENS_STAT_CHAN_COUNT) ? chan_names[chan] : "?";
+}
+
+const char *sens_stat_win_name(enum sens_stat_win win)
+{
+	return (win < SENS_STAT_WIN_COUNT) ? win_names[win] : "?";
+}
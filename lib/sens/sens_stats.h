@@ -0,0 +1,48 @@
+/**
+ * @file sens_stats.h
+ * @author Wilfred Mallawa
+ * @brief Sliding window min/max/mean/stddev of the climate channels.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_STATS_H
+#define SENS_STATS_H
+
+#include "sens.h"
+
+/* Channels tracked, values in sens_packet units */
+enum sens_stat_chan {
+    SENS_STAT_TEMP,         //hts221 centi-celsius
+    SENS_STAT_RH,           //centi-rh%
+    SENS_STAT_PRESS,        //Pa
+    SENS_STAT_ECO2,         //ppm
+    SENS_STAT_ETVOC,        //ppb
+    SENS_STAT_CHAN_COUNT,
+};
+
+enum sens_stat_win {
+    SENS_STAT_1MIN,
+    SENS_STAT_1H,
+    SENS_STAT_24H,
+    SENS_STAT_WIN_COUNT,
+};
+
+/* Window summary, same units as the channel */
+struct sens_stat {
+    int32_t min;
+    int32_t max;
+    int32_t mean;
+    int32_t stddev;
+    uint32_t count;         //samples in the window, 0 if empty
+};
+
+/* Function Declarations */
+extern void sens_stats_update(const struct sens_packet *pkt, uint32_t now_ms);
+extern int sens_stats_get(enum sens_stat_chan chan, enum sens_stat_win win,
+                          struct sens_stat *out);
+extern const char *sens_stat_chan_name(enum sens_stat_chan chan);
+extern const char *sens_stat_win_name(enum sens_stat_win win);
+/* ---------------------- */
+
+#endif
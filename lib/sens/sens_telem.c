@@ -0,0 +1,218 @@
+/**
+ * @file sens_telem.c
+ * @author Wilfred Mallawa
+ * @brief Binary telemetry stream. A low priority thread subscribes to the
+ *        sensor bus like the display does, so sens_thread never waits on
+ *        it: a slow link only makes this thread lose the oldest packets,
+ *        which the frame header counts. Packets are converted to the
+ *        fixed records of sens_telem_proto.h, batched, and a batch goes
+ *        out once full or APP_SENS_TELEM_FLUSH_MS after its first record.
+ *        tools/telem_decode.c turns the stream back into CSV.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <zephyr/zephyr.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#ifdef CONFIG_APP_SENS_TELEM_UART
+#include <zephyr/drivers/uart.h>
+#endif
+#ifdef CONFIG_APP_SENS_TELEM_RTT
+#include <SEGGER_RTT.h>
+#endif
+
+#include "sens.h"
+#include "sens_bus.h"
+#include "sens_telem.h"
+
+LOG_MODULE_REGISTER(sens_telem, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define BATCH       CONFIG_APP_SENS_TELEM_BATCH
+
+BUILD_ASSERT(BATCH <= SENS_TELEM_BATCH_MAX, "batch does not fit a frame");
+BUILD_ASSERT(sizeof(struct sens_telem_hdr) == 8 && sizeof(struct sens_telem_rec) == 32,
+	     "telemetry wire format changed, bump SENS_TELEM_VERSION");
+
+static struct {
+	struct sens_telem_hdr hdr;
+	struct sens_telem_rec rec[BATCH];
+	uint8_t crc[2];                 //placed after the last record used
+} __packed frame;
+
+/* Encoded frame between delimiters */
+static uint8_t wire[SENS_TELEM_COBS_MAX + 2];
+static struct sens_telem_stats st;
+
+#ifdef CONFIG_APP_SENS_TELEM_UART
+#if DT_HAS_CHOSEN(app_telem_uart)
+static const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(app_telem_uart));
+#else
+static const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(zephyr_console));
+#endif
+
+static int telem_backend_init(void)
+{
+	return device_is_ready(uart) ? 0 : -ENODEV;
+}
+
+/* Polled out of this thread, sens_thread preempts it between bytes */
+static int telem_write(const uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uart_poll_out(uart, buf[i]);
+	}
+	return 0;
+}
+#endif /* CONFIG_APP_SENS_TELEM_UART */
+
+#ifdef CONFIG_APP_SENS_TELEM_RTT
+static uint8_t rtt_buf[CONFIG_APP_SENS_TELEM_RTT_BUF_SIZE];
+
+static int telem_backend_init(void)
+{
+	int rc = SEGGER_RTT_ConfigUpBuffer(CONFIG_APP_SENS_TELEM_RTT_CHANNEL, "telem",
+					   rtt_buf, sizeof(rtt_buf),
+					   SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+
+	return (rc < 0) ? -EINVAL : 0;
+}
+
+/* Whole frame or nothing, the host never sees half a frame */
+static int telem_write(const uint8_t *buf, size_t len)
+{
+	return (SEGGER_RTT_Write(CONFIG_APP_SENS_TELEM_RTT_CHANNEL, buf, len) == len) ?
+	       0 : -ENOSPC;
+}
+#endif /* CONFIG_APP_SENS_TELEM_RTT */
+
+/*
+ * COBS: every zero is replaced by the distance to the next one, so the
+ * frame holds no zero bytes and a zero can delimit it. Returns the
+ * encoded length.
+ */
+static size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	size_t code_at = 0;
+	size_t o = 1;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < len; i++) {
+		if (in[i] != 0) {
+			out[o++] = in[i];
+			code++;
+		}
+		if (in[i] == 0 || code == 0xff) {
+			out[code_at] = code;
+			code_at = o++;
+			code = 1;
+		}
+	}
+	out[code_at] = code;
+	return o;
+}
+
+static void rec_fill(struct sens_telem_rec *rec, uint32_t seq,
+		     const struct sens_packet *pkt)
+{
+	*rec = (struct sens_telem_rec){
+		.seq = sys_cpu_to_le32(seq),
+		.time_ms = sys_cpu_to_le32(k_uptime_get_32()),
+		.press = sys_cpu_to_le32(pkt->lps22hb_press),
+		.temp = sys_cpu_to_le16(pkt->hts221_temp),
+		.rh = sys_cpu_to_le16(pkt->hts221_rh),
+		.ptemp = sys_cpu_to_le16(pkt->lps22hb_temp),
+		.xy_angle = sys_cpu_to_le16(pkt->xy_angle),
+		.batt_mV = sys_cpu_to_le16(pkt->batt_mV),
+		.eco2 = sys_cpu_to_le16(pkt->ccs811_eco2),
+		.etvoc = sys_cpu_to_le16(pkt->ccs811_etvoc),
+		.batt_pptt = sys_cpu_to_le16(pkt->batt_pptt),
+		.batt_tte_min = sys_cpu_to_le16(pkt->batt_tte_min),
+		.valid = pkt->valid,
+	};
+}
+
+/* Header, CRC and COBS around the first count records, into wire. Returns its length */
+static size_t frame_build(uint8_t count)
+{
+	size_t raw = sizeof(frame.hdr) + count * sizeof(frame.rec[0]);
+	uint8_t *crc_at = (uint8_t *)&frame + raw;
+	size_t len;
+
+	frame.hdr = (struct sens_telem_hdr){
+		.version = SENS_TELEM_VERSION,
+		.count = count,
+		.frame_seq = sys_cpu_to_le16(st.frames),
+		.dropped = sys_cpu_to_le32(st.dropped),
+	};
+	sys_put_le16(crc16_ccitt(SENS_TELEM_CRC_SEED, (uint8_t *)&frame, raw), crc_at);
+
+	/* Leading zero too, so console text before it is not taken as frame */
+	wire[0] = 0;
+	len = cobs_encode((uint8_t *)&frame, raw + 2, wire + 1) + 1;
+	wire[len++] = 0;
+	return len;
+}
+
+static void telem_send(uint8_t count)
+{
+	size_t len = frame_build(count);
+
+	if (telem_write(wire, len) != 0) {
+		st.write_errors++;
+		return;
+	}
+	st.frames++;
+	st.records += count;
+	st.bytes += len;
+}
+
+void sens_telem_thread(void *p1, void *p2, void *p3)
+{
+	static struct sens_bus_sub sub;
+	const struct sens_packet *pkt;
+	struct sens_packet copy;
+	int64_t deadline = 0;
+	uint8_t count = 0;
+	int rc;
+
+	rc = telem_backend_init();
+	if (rc != 0) {
+		LOG_ERR("telem: backend init failed: %d", rc);
+		return;
+	}
+	sens_bus_subscribe(&sub);
+	LOG_INF("telem: %u records per frame", BATCH);
+
+	while (1) {
+		k_timeout_t timeout = K_FOREVER;
+
+		if (count != 0) {
+			timeout = K_MSEC(MAX(deadline - k_uptime_get(), 0));
+		}
+		pkt = sens_bus_get(&sub, timeout);
+		if (pkt != NULL) {
+			copy = *pkt;
+			if (sens_bus_release(&sub)) {
+				rec_fill(&frame.rec[count++], sub.seq, &copy);
+				if (count == 1) {
+					deadline = k_uptime_get() + CONFIG_APP_SENS_TELEM_FLUSH_MS;
+				}
+			} else {
+				st.dropped++;
+			}
+			st.dropped += sub.dropped;
+			sub.dropped = 0;
+		}
+		if (count == BATCH || (count != 0 && k_uptime_get() >= deadline)) {
+			telem_send(count);
+			count = 0;
+		}
+	}
+}
+
+void sens_telem_stats_get(struct sens_telem_stats *stats)
+{
+	*stats = st;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file sens_telem.h
+ * @author Wilfred Mallawa
+ * @brief Binary telemetry, packets from the sensor bus batched into COBS
+ *        frames and streamed over a UART or an RTT channel.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_TELEM_H
+#define SENS_TELEM_H
+
+#include <stdint.h>
+
+#include "sens_telem_proto.h"
+
+/* Telemetry Thread Details, below the sensor and display threads */
+#define SENS_TELEM_T_STACK_SIZE 1536
+#define SENS_TELEM_T_PRIOR 7
+
+struct sens_telem_stats {
+    uint32_t frames;
+    uint32_t records;
+    uint32_t bytes;         //on the wire, delimiters included
+    uint32_t dropped;       //lapped on the bus or torn while copied
+    uint32_t write_errors;  //frames the backend could not take
+};
+
+/* Function Declarations */
+extern void sens_telem_thread(void *, void *, void *);
+extern void sens_telem_stats_get(struct sens_telem_stats *stats);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file sens_telem_proto.h
+ * @author Wilfred Mallawa
+ * @brief Telemetry wire format, shared with the host decoder so it has
+ *        no Zephyr dependencies. A frame is a header, count records and
+ *        a CRC-16 of both, COBS encoded and sent between zero bytes.
+ *        Multi-byte fields are little endian.
+ *
+ *          0x00 | COBS( hdr (8) | rec (32) * count | crc16 (2) ) | 0x00
+ *
+ *        The CRC is Zephyr's crc16_ccitt() seeded with 0xffff (reflected
+ *        polynomial 0x8408, no final xor).
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef SENS_TELEM_PROTO_H
+#define SENS_TELEM_PROTO_H
+
+#include <stdint.h>
+
+#define SENS_TELEM_VERSION      1
+#define SENS_TELEM_BATCH_MAX    16
+#define SENS_TELEM_CRC_SEED     0xffff
+
+struct sens_telem_hdr {
+    uint8_t version;        //SENS_TELEM_VERSION
+    uint8_t count;          //records that follow, 1..SENS_TELEM_BATCH_MAX
+    uint16_t frame_seq;     //frames sent since boot, wraps
+    uint32_t dropped;       //packets lost before framing, since boot
+} __attribute__((packed));
+
+/* One sens_packet, as published on the sensor bus */
+struct sens_telem_rec {
+    uint32_t seq;           //bus sequence, gaps are dropped packets
+    uint32_t time_ms;       //uptime on receipt from the sensor bus
+    uint32_t press;         //Pa
+    int16_t temp;           //centi-celsius
+    uint16_t rh;            //centi-rh%
+    int16_t ptemp;          //centi-celsius
+    int16_t xy_angle;       //centi-degrees
+    uint16_t batt_mV;
+    uint16_t eco2;          //ppm
+    uint16_t etvoc;         //ppb
+    uint16_t batt_pptt;
+    uint16_t batt_tte_min;
+    uint8_t valid;          //SENS_VALID_* mask
+    uint8_t reserved;
+} __attribute__((packed));
+
+#define SENS_TELEM_RAW_MAX  (sizeof(struct sens_telem_hdr) + \
+                             SENS_TELEM_BATCH_MAX * sizeof(struct sens_telem_rec) + 2)
+/* COBS adds a byte per 254 and the leading code byte */
+#define SENS_TELEM_COBS_MAX (SENS_TELEM_RAW_MAX + SENS_TELEM_RAW_MAX / 254 + 1)
+
+#endif
@@ -14,18 +14,32 @@
 #include <zephyr/logging/log.h>
 #include "sens.h"
 #include "display_ctl.h"
+#ifdef CONFIG_APP_BENCH
+#include "bench.h"
+#endif
+#ifdef CONFIG_APP_SENS_TELEM
+#include "sens_telem.h"
+#endif
 
 LOG_MODULE_REGISTER(core, CONFIG_LOG_DEFAULT_LEVEL);
 
 /* Thread Data */
+#ifdef CONFIG_APP_DISP
 /* Display control thread data */
 struct k_thread disp_t_data = {0};
 k_tid_t disp_tid = {0};
 K_THREAD_STACK_DEFINE(disp_t_stack_area, DISP_T_STACK_SIZE);
+#endif
 /* Sensor control thread data */
 struct k_thread sens_t_data = {0};
 k_tid_t sens_tid = {0};
 K_THREAD_STACK_DEFINE(sens_t_stack_area, SENS_T_STACK_SIZE);
+#ifdef CONFIG_APP_SENS_TELEM
+/* Telemetry thread data */
+struct k_thread telem_t_data = {0};
+k_tid_t telem_tid = {0};
+K_THREAD_STACK_DEFINE(telem_t_stack_area, SENS_TELEM_T_STACK_SIZE);
+#endif
 
 /* 1000 msec = 1 sec */
 #define SLEEP_TIME_MS   1000
@@ -34,8 +48,9 @@ K_THREAD_STACK_DEFINE(sens_t_stack_area, SENS_T_STACK_SIZE);
 #define LED0_NODE DT_ALIAS(led0)
 #define LED2_NODE DT_ALIAS(led2)
 
-static const struct gpio_dt_spec led1 = GPIO_DT_SPEC_GET(LED0_NODE, gpios);
-static const struct gpio_dt_spec led2 = GPIO_DT_SPEC_GET(LED2_NODE, gpios);
+/* Boards without the LEDs, such as native_posix, get a NULL port */
+static const struct gpio_dt_spec led1 = GPIO_DT_SPEC_GET_OR(LED0_NODE, gpios, {0});
+static const struct gpio_dt_spec led2 = GPIO_DT_SPEC_GET_OR(LED2_NODE, gpios, {0});
 
 
 int thread_init(void) {
@@ -44,12 +59,25 @@ int thread_init(void) {
                                  sens_thread,
                                  NULL, NULL, NULL,
                                  SENS_T_PRIOR, 0, K_NO_WAIT);
+	k_thread_name_set(sens_tid, "sens");
 
+#ifdef CONFIG_APP_DISP
 	disp_tid = k_thread_create(&disp_t_data, disp_t_stack_area,
                                  K_THREAD_STACK_SIZEOF(disp_t_stack_area),
                                  disp_ctl_thread,
                                  NULL, NULL, NULL,
                                  DISP_T_PRIOR, 0, K_NO_WAIT);
+	k_thread_name_set(disp_tid, "disp");
+#endif
+
+#ifdef CONFIG_APP_SENS_TELEM
+	telem_tid = k_thread_create(&telem_t_data, telem_t_stack_area,
+                                 K_THREAD_STACK_SIZEOF(telem_t_stack_area),
+                                 sens_telem_thread,
+                                 NULL, NULL, NULL,
+                                 SENS_TELEM_T_PRIOR, 0, K_NO_WAIT);
+	k_thread_name_set(telem_tid, "telem");
+#endif
 
 	LOG_INF("Sys threads init OK");
 	return 0;
@@ -60,6 +88,11 @@ int thread_init(void) {
  */
 void main(void)
 {
+#ifdef CONFIG_APP_BENCH
+	/* Before the threads, so nothing else runs or draws meanwhile */
+	bench_run();
+#endif
+
 	/* Init systhreads */
 	thread_init();
 
@@ -0,0 +1,32 @@
+/**
+ * @file telem_dev.c
+ * @author Wilfred Mallawa
+ * @brief The device telemetry code, included to reach its static
+ *        functions. Its thread is not started, frames are built here
+ *        and handed to the test instead of the link.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include "sens_telem.c"
+#include "telem_hooks.h"
+
+size_t telem_dev_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+	return cobs_encode(in, len, out);
+}
+
+/* One frame of count packets with bus sequence from seq, as the thread sends it */
+size_t telem_dev_frame(const struct sens_packet *pkts, uint8_t count,
+		       uint32_t seq, uint32_t dropped, uint8_t *out)
+{
+	size_t len;
+
+	for (uint8_t i = 0; i < count; i++) {
+		rec_fill(&frame.rec[i], seq + i, &pkts[i]);
+	}
+	st.dropped = dropped;
+	len = frame_build(count);
+	memcpy(out, wire, len);
+	return len;
+}
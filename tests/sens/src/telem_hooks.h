@@ -0,0 +1,41 @@
+/**
+ * @file telem_hooks.h
+ * @author Wilfred Mallawa
+ * @brief Entry points into the static telemetry code, the device side
+ *        from lib/sens/sens_telem.c and the host side from
+ *        tools/telem_decode.c, each built in its own file.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#ifndef TELEM_HOOKS_H
+#define TELEM_HOOKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sens.h"
+
+/* Host decoder counters, as telem_decode prints them */
+struct telem_host_counts {
+    unsigned long frames;
+    unsigned long records;
+    unsigned long rejected;     //bad COBS, CRC or length
+    unsigned long seq_gaps;
+    unsigned long dropped;      //as the last good frame reported it
+};
+
+/* Called by the host decoder with each record of a good frame */
+typedef void (*telem_host_rec_fn)(const uint8_t *rec);
+
+/* Function Declarations */
+extern size_t telem_dev_cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+extern size_t telem_dev_frame(const struct sens_packet *pkts, uint8_t count,
+                              uint32_t seq, uint32_t dropped, uint8_t *out);
+extern int telem_host_cobs_decode(uint8_t *buf, size_t len);
+extern int telem_host_frame_decode(uint8_t *buf, size_t len);
+extern void telem_host_feed(const uint8_t *in, size_t len, telem_host_rec_fn on_rec);
+extern void telem_host_counts_get(struct telem_host_counts *counts);
+/* ---------------------- */
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * @file telem_host.c
+ * @author Wilfred Mallawa
+ * @brief The host decoder without its main() and POSIX I/O. Kept apart
+ *        from telem_dev.c, both have a static st and a crc16_ccitt.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#define TELEM_DECODE_LIB
+#include "telem_decode.c"
+#include "telem_hooks.h"
+
+int telem_host_cobs_decode(uint8_t *buf, size_t len)
+{
+	return cobs_decode(buf, len);
+}
+
+static void rec_skip(const uint8_t *rec)
+{
+}
+
+/* Records decoded from one delimited frame, -1 if it was rejected */
+int telem_host_frame_decode(uint8_t *buf, size_t len)
+{
+	unsigned long frames = st.frames;
+	unsigned long records = st.records;
+
+	frame_decode(buf, len, rec_skip);
+	return (st.frames == frames) ? -1 : (int)(st.records - records);
+}
+
+/* Raw link bytes, split on delimiters as main() reads them */
+void telem_host_feed(const uint8_t *in, size_t len, telem_host_rec_fn on_rec)
+{
+	static struct stream s;
+
+	stream_feed(&s, in, len, on_rec);
+}
+
+void telem_host_counts_get(struct telem_host_counts *counts)
+{
+	*counts = (struct telem_host_counts){
+		.frames = st.frames,
+		.records = st.records,
+		.rejected = st.bad_cobs + st.bad_crc + st.bad_len,
+		.seq_gaps = st.seq_gaps,
+		.dropped = st.dropped,
+	};
+}
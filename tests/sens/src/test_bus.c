@@ -0,0 +1,81 @@
+/**
+ * @file test_bus.c
+ * @author Wilfred Mallawa
+ * @brief sens_bus ordering, lapping and torn read detection. There is
+ *        no unsubscribe, so each test's subscriber is static.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <ztest.h>
+
+#include "sens_bus.h"
+
+#define DEPTH CONFIG_APP_SENS_BUS_DEPTH
+
+static void publish_n(int n, int16_t first)
+{
+	for (int i = 0; i < n; i++) {
+		struct sens_packet pkt = { .hts221_temp = first + i };
+
+		sens_bus_publish(&pkt);
+	}
+}
+
+ZTEST(sens_bus, test_in_order)
+{
+	static struct sens_bus_sub sub;
+	const struct sens_packet *pkt;
+
+	sens_bus_subscribe(&sub);
+	zassert_is_null(sens_bus_get(&sub, K_NO_WAIT), "nothing published yet");
+
+	publish_n(DEPTH - 2, 100);
+	for (int i = 0; i < DEPTH - 2; i++) {
+		pkt = sens_bus_get(&sub, K_NO_WAIT);
+		zassert_not_null(pkt, "packet %d missing", i);
+		zassert_equal(pkt->hts221_temp, 100 + i, "out of order");
+		zassert_true(sens_bus_release(&sub), "slot recycled");
+	}
+	zassert_equal(sub.dropped, 0, "dropped %u", sub.dropped);
+	zassert_equal(sub.seq, sens_bus_seq(), "not at the newest");
+	zassert_is_null(sens_bus_get(&sub, K_NO_WAIT), "read past the newest");
+}
+
+ZTEST(sens_bus, test_lapped)
+{
+	static struct sens_bus_sub sub;
+	const struct sens_packet *pkt;
+
+	sens_bus_subscribe(&sub);
+	publish_n(10, 200);
+
+	/* The writer may be filling the oldest slot, it is skipped too */
+	pkt = sens_bus_get(&sub, K_NO_WAIT);
+	zassert_not_null(pkt, "packet missing");
+	zassert_equal(pkt->hts221_temp, 200 + 10 - (DEPTH - 1), "not the oldest safe");
+	zassert_equal(sub.dropped, 10 - (DEPTH - 1), "dropped %u", sub.dropped);
+	zassert_true(sens_bus_release(&sub), "slot recycled");
+
+	/* Lapped while holding the packet, the read is reported torn */
+	publish_n(DEPTH, 300);
+	zassert_false(sens_bus_release(&sub), "torn read not detected");
+}
+
+ZTEST(sens_bus, test_latest)
+{
+	static struct sens_bus_sub sub;
+	const struct sens_packet *pkt;
+
+	sens_bus_subscribe(&sub);
+	zassert_is_null(sens_bus_get_latest(&sub, K_NO_WAIT), "nothing published yet");
+
+	publish_n(3, 400);
+	pkt = sens_bus_get_latest(&sub, K_NO_WAIT);
+	zassert_not_null(pkt, "packet missing");
+	zassert_equal(pkt->hts221_temp, 402, "not the newest");
+	zassert_equal_ptr(sens_bus_peek(&sub), pkt, "peek differs");
+	zassert_is_null(sens_bus_get_latest(&sub, K_NO_WAIT), "newest handed out twice");
+}
+
+ZTEST_SUITE(sens_bus, NULL, NULL, NULL, NULL, NULL);
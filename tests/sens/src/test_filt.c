@@ -0,0 +1,121 @@
+/**
+ * @file test_filt.c
+ * @author Wilfred Mallawa
+ * @brief Filter stages on their own channels, see prj.conf: median on
+ *        temperature, Kalman on humidity, biquad on pressure, EMA on the
+ *        LPS22HB temperature and all four on eCO2.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+#include <ztest.h>
+
+#include "sens_filt.h"
+
+ZTEST(sens_filt, test_stages)
+{
+	zassert_equal(sens_filt_stages(SENS_FILT_TEMP), BIT(SENS_FILT_MEDIAN), "temp");
+	zassert_equal(sens_filt_stages(SENS_FILT_RH), BIT(SENS_FILT_KALMAN), "rh");
+	zassert_equal(sens_filt_stages(SENS_FILT_PRESS), BIT(SENS_FILT_BIQUAD), "press");
+	zassert_equal(sens_filt_stages(SENS_FILT_PTEMP), BIT(SENS_FILT_EMA), "ptemp");
+
+	/* No stages, readings pass through */
+	zassert_equal(sens_filt_run(SENS_FILT_TVOC, 123), 123, "pass through");
+	zassert_equal(sens_filt_run(SENS_FILT_TVOC, -7), -7, "pass through");
+}
+
+ZTEST(sens_filt, test_median)
+{
+	static const int32_t in[] = {
+		2000, 2000, 9000, 2000, 2000, 2000, -500, -500, 2000, 2000, 2000,
+	};
+
+	/* Spikes shorter than half the window never come through */
+	for (int i = 0; i < ARRAY_SIZE(in); i++) {
+		zassert_equal(sens_filt_run(SENS_FILT_TEMP, in[i]), 2000, "spike at %d", i);
+	}
+	/* A real step does, after half the window */
+	for (int i = 0; i < CONFIG_APP_SENS_FILT_MEDIAN_N; i++) {
+		int32_t out = sens_filt_run(SENS_FILT_TEMP, 2500);
+
+		zassert_equal(out, (i < CONFIG_APP_SENS_FILT_MEDIAN_N / 2) ? 2000 : 2500,
+			      "step at %d: %d", i, out);
+	}
+}
+
+ZTEST(sens_filt, test_kalman)
+{
+	int32_t last = 4000;
+
+	zassert_equal(sens_filt_run(SENS_FILT_RH, 4000), 4000, "seeded");
+	for (int i = 0; i < 200; i++) {
+		int32_t out = sens_filt_run(SENS_FILT_RH, 5000);
+
+		zassert_true(out >= last && out <= 5000, "not monotonic at %d: %d", i, out);
+		last = out;
+	}
+	zassert_within(last, 5000, 1, "settled at %d", last);
+}
+
+ZTEST(sens_filt, test_biquad)
+{
+	int32_t out, peak = 0;
+
+	/* Unity DC gain, a constant comes back exactly */
+	for (int i = 0; i < 100; i++) {
+		zassert_equal(sens_filt_run(SENS_FILT_PRESS, 101325), 101325,
+			      "DC gain at %d", i);
+	}
+	/* Step response, Butterworth overshoot is about 4 % */
+	for (int i = 0; i < 200; i++) {
+		out = sens_filt_run(SENS_FILT_PRESS, 102325);
+		peak = MAX(peak, out);
+	}
+	zassert_true(peak - 102325 <= 60, "overshoot %d Pa", peak - 102325);
+	zassert_equal(out, 102325, "settled at %d", out);
+
+	/* Fast alternation is attenuated */
+	for (int i = 0; i < 200; i++) {
+		out = sens_filt_run(SENS_FILT_PRESS, 102325 + ((i & 1) ? 100 : -100));
+	}
+	zassert_within(out, 102325, 10, "Nyquist passed, %d", out);
+}
+
+ZTEST(sens_filt, test_ema)
+{
+	const int shift = CONFIG_APP_SENS_FILT_EMA_SHIFT;
+	int32_t out;
+
+	zassert_equal(sens_filt_run(SENS_FILT_PTEMP, 0), 0, "seeded");
+	out = sens_filt_run(SENS_FILT_PTEMP, 1024);
+	zassert_equal(out, 1024 >> shift, "first step %d", out);
+	for (int i = 0; i < 100; i++) {
+		out = sens_filt_run(SENS_FILT_PTEMP, 1024);
+	}
+	zassert_equal(out, 1024, "settled at %d", out);
+	/* Negative readings round the same way */
+	for (int i = 0; i < 100; i++) {
+		out = sens_filt_run(SENS_FILT_PTEMP, -1024);
+	}
+	zassert_equal(out, -1024, "settled at %d", out);
+}
+
+ZTEST(sens_filt, test_chain)
+{
+	struct sens_filt_cost cost;
+	int32_t out;
+
+	/* All four stages, a spike is dropped before the smoothing */
+	for (int i = 0; i < 50; i++) {
+		out = sens_filt_run(SENS_FILT_ECO2, (i == 30) ? 8000 : 600);
+		zassert_equal(out, 600, "eCO2 at %d: %d", i, out);
+	}
+	for (int s = 0; s < SENS_FILT_STAGE_COUNT; s++) {
+		sens_filt_cost_get(s, &cost);
+		zassert_true(cost.calls >= 50, "%s ran %u times", sens_filt_stage_name(s),
+			     cost.calls);
+	}
+}
+
+ZTEST_SUITE(sens_filt, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,90 @@
+/**
+ * @file test_fuel.c
+ * @author Wilfred Mallawa
+ * @brief sens_fuel level table against straight interpolation of the
+ *        devicetree curve, and the filter and time to empty. The ADC
+ *        side is only built with the hardware backend.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+#include <ztest.h>
+#include <zephyr/devicetree.h>
+
+#include "sens_fuel.h"
+
+#define CURVE       DT_CHOSEN(app_battery_curve)
+#define CURVE_ELEM(node, prop, idx) DT_PROP_BY_IDX(node, prop, idx),
+
+static const int curve_mv[] = { DT_FOREACH_PROP_ELEM(CURVE, curve_mv, CURVE_ELEM) };
+static const int curve_pptt[] = { DT_FOREACH_PROP_ELEM(CURVE, curve_pptt, CURVE_ELEM) };
+
+/* Level between the two curve points around mv, as battery_level_pptt() */
+static int ref_pptt(int mv)
+{
+	int k = 1;
+
+	if (mv >= curve_mv[0]) {
+		return curve_pptt[0];
+	}
+	while (k < ARRAY_SIZE(curve_mv) - 1 && mv < curve_mv[k]) {
+		k++;
+	}
+	if (mv < curve_mv[k]) {
+		return curve_pptt[k];
+	}
+	return curve_pptt[k] + (curve_pptt[k - 1] - curve_pptt[k]) *
+	       (mv - curve_mv[k]) / (curve_mv[k - 1] - curve_mv[k]);
+}
+
+ZTEST(sens_fuel, test_table)
+{
+	int worst = 0;
+
+	for (int mv = curve_mv[ARRAY_SIZE(curve_mv) - 1] - 100; mv <= curve_mv[0] + 100; mv++) {
+		worst = MAX(worst, abs((int)sens_fuel_pptt(mv) - ref_pptt(mv)));
+	}
+	/* 0.4 % of full scale */
+	zassert_true(worst <= 40, "table off by %d pptt", worst);
+	zassert_equal(sens_fuel_pptt(curve_mv[0]), curve_pptt[0], "top of the curve");
+	zassert_equal(sens_fuel_pptt(1000), 0, "below the curve");
+}
+
+ZTEST(sens_fuel, test_discharge)
+{
+	const uint32_t step_ms = 60 * MSEC_PER_SEC;
+	struct sens_fuel_state st;
+	uint32_t now = 0;
+
+	/* Steady with noise under the hysteresis, no rate yet */
+	for (int i = 0; i < 30; i++) {
+		sens_fuel_update(3800 + ((i & 1) ? 2 : -2), now);
+		now += step_ms;
+	}
+	sens_fuel_get(&st);
+	zassert_within(st.mV, 3800, CONFIG_APP_SENS_FUEL_HYST_MV, "%u mV", st.mV);
+	zassert_equal(st.pptt, sens_fuel_pptt(st.mV), "level of the shown voltage");
+
+	/* 1 mV a minute, about 1.5 % an hour on the upper segment */
+	for (int i = 0; i < 240; i++) {
+		sens_fuel_update(3800 - i, now);
+		now += step_ms;
+	}
+	sens_fuel_get(&st);
+	zassert_true(st.rate_pptth > 0, "rate %d", st.rate_pptth);
+	zassert_not_equal(st.tte_min, SENS_FUEL_TTE_UNKNOWN, "no time to empty");
+	zassert_within(st.tte_min, (uint32_t)st.pptt * 60 / st.rate_pptth, 1,
+		       "tte %u", st.tte_min);
+
+	/* Charging again, the estimate is withdrawn */
+	for (int i = 0; i < 240; i++) {
+		sens_fuel_update(3600 + 2 * i, now);
+		now += step_ms;
+	}
+	sens_fuel_get(&st);
+	zassert_true(st.rate_pptth < 0, "rate %d", st.rate_pptth);
+	zassert_equal(st.tte_min, SENS_FUEL_TTE_UNKNOWN, "tte %u", st.tte_min);
+}
+
+ZTEST_SUITE(sens_fuel, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,177 @@
+/**
+ * @file test_hist.c
+ * @author Wilfred Mallawa
+ * @brief sens_hist codec round trip, ring recycling and the bytes per
+ *        sample of a steady indoor trace. The store is shared by the
+ *        tests, so each one appends after the last and reads back from
+ *        its own start.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <ztest.h>
+
+#include "sens_hist.h"
+
+#define TICK_MS CONFIG_APP_SENS_HIST_TICK_MS
+
+static uint32_t now_ms = TICK_MS;
+static uint32_t rnd = 1;
+
+/* Deterministic LCG, the same trace on every run */
+static int32_t rand_step(int32_t range)
+{
+	rnd = rnd * 1103515245 + 12345;
+	return (int32_t)((rnd >> 16) % (2 * range + 1)) - range;
+}
+
+/* Random walk around indoor values, a few channels move per sample */
+static void walk(struct sens_packet *pkt)
+{
+	pkt->hts221_temp += rand_step(8);
+	pkt->hts221_rh += rand_step(15);
+	pkt->lps22hb_press += rand_step(12);
+	pkt->lps22hb_temp += rand_step(8);
+	if (rand_step(4) == 0) {
+		pkt->xy_angle += rand_step(200);
+		pkt->ccs811_eco2 += rand_step(5);
+		pkt->ccs811_etvoc += rand_step(2);
+	}
+	if (rand_step(30) == 0) {
+		pkt->batt_mV -= 1;
+	}
+	/* the CCS811 drops out now and then */
+	if (rand_step(40) == 0) {
+		pkt->valid ^= SENS_VALID_CCS811;
+	}
+}
+
+static const struct sens_packet start_pkt = {
+	.lps22hb_press = 101325,
+	.hts221_temp = 2150,
+	.hts221_rh = 4500,
+	.lps22hb_temp = 2210,
+	.xy_angle = -120,
+	.batt_mV = 3900,
+	.ccs811_eco2 = 600,
+	.ccs811_etvoc = 40,
+	.valid = SENS_VALID_HTS221 | SENS_VALID_LPS22HB | SENS_VALID_CCS811 |
+		 SENS_VALID_LIS2DH | SENS_VALID_BATT,
+};
+
+/* Packet values at history resolution */
+static void quantise(const struct sens_packet *in, struct sens_packet *out)
+{
+	*out = (struct sens_packet){
+		.lps22hb_press = in->lps22hb_press / 10 * 10,
+		.hts221_temp = in->hts221_temp / 10 * 10,
+		.hts221_rh = in->hts221_rh / 10 * 10,
+		.lps22hb_temp = in->lps22hb_temp / 10 * 10,
+		.xy_angle = in->xy_angle / 10 * 10,
+		.batt_mV = in->batt_mV,
+		.ccs811_eco2 = in->ccs811_eco2,
+		.ccs811_etvoc = in->ccs811_etvoc,
+		.valid = in->valid,
+	};
+}
+
+ZTEST(sens_hist, test_round_trip)
+{
+	static struct sens_packet sent[200];
+	struct sens_packet pkt = start_pkt;
+	uint32_t from_ms = now_ms;
+	struct sens_hist_iter it;
+	struct sens_hist_sample s;
+	int n = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(sent); i++) {
+		walk(&pkt);
+		sent[i] = pkt;
+		sens_hist_append(&pkt, now_ms);
+		/* an irregular interval now and then */
+		now_ms += (i % 50 == 49) ? 3 * TICK_MS : TICK_MS;
+	}
+
+	sens_hist_iter_init(&it, from_ms);
+	while (sens_hist_next(&it, &s) == 0) {
+		struct sens_packet want;
+
+		zassert_true(n < ARRAY_SIZE(sent), "more samples than appended");
+		quantise(&sent[n], &want);
+		zassert_equal(s.pkt.lps22hb_press, want.lps22hb_press, "press at %d", n);
+		zassert_equal(s.pkt.hts221_temp, want.hts221_temp, "temp at %d", n);
+		zassert_equal(s.pkt.hts221_rh, want.hts221_rh, "rh at %d", n);
+		zassert_equal(s.pkt.lps22hb_temp, want.lps22hb_temp, "ptemp at %d", n);
+		zassert_equal(s.pkt.xy_angle, want.xy_angle, "angle at %d", n);
+		zassert_equal(s.pkt.batt_mV, want.batt_mV, "batt at %d", n);
+		zassert_equal(s.pkt.ccs811_eco2, want.ccs811_eco2, "eco2 at %d", n);
+		zassert_equal(s.pkt.ccs811_etvoc, want.ccs811_etvoc, "etvoc at %d", n);
+		zassert_equal(s.pkt.valid, want.valid, "valid at %d", n);
+		n++;
+	}
+	zassert_equal(n, ARRAY_SIZE(sent), "decoded %d of %d", n, (int)ARRAY_SIZE(sent));
+}
+
+ZTEST(sens_hist, test_wrap)
+{
+	struct sens_packet pkt = start_pkt;
+	struct sens_hist_stats st;
+	struct sens_hist_iter it;
+	struct sens_hist_sample s;
+	uint32_t last_ms = 0;
+	uint32_t n = 0;
+
+	/* Several times what the store holds */
+	for (int i = 0; i < 20 * CONFIG_APP_SENS_HIST_SIZE / 4; i++) {
+		walk(&pkt);
+		sens_hist_append(&pkt, now_ms);
+		now_ms += TICK_MS;
+	}
+
+	sens_hist_stats_get(&st);
+	zassert_true(st.dropped > 0, "store never recycled");
+	zassert_true(st.bytes <= st.capacity, "%u bytes over %u", st.bytes, st.capacity);
+	zassert_equal(st.newest_ms, now_ms - TICK_MS, "newest %u", st.newest_ms);
+
+	/* From the start of time, the decoder resumes at the oldest block */
+	sens_hist_iter_init(&it, 0);
+	while (sens_hist_next(&it, &s) == 0) {
+		zassert_true(s.t_ms > last_ms, "time went back at %u", s.t_ms);
+		last_ms = s.t_ms;
+		n++;
+	}
+	zassert_equal(n, st.samples, "decoded %u of %u", n, st.samples);
+	zassert_equal(last_ms, st.newest_ms, "ends at %u", last_ms);
+}
+
+/*
+ * Store use of a steady 1 Hz indoor trace, readings moving by about
+ * their display resolution, as 'sens history stats' reports it on target.
+ */
+ZTEST(sens_hist, test_bytes_per_sample)
+{
+	struct sens_packet pkt = start_pkt;
+	struct sens_hist_stats st;
+	uint32_t centi;
+
+	for (int i = 0; i < 20000; i++) {
+		pkt.hts221_temp += rand_step(4);
+		pkt.hts221_rh += rand_step(6);
+		pkt.lps22hb_press += rand_step(5);
+		pkt.lps22hb_temp += rand_step(4);
+		pkt.ccs811_eco2 += (rand_step(3) == 0) ? rand_step(2) : 0;
+		pkt.ccs811_etvoc += (rand_step(6) == 0) ? rand_step(1) : 0;
+		pkt.batt_mV -= (rand_step(200) == 0);
+		sens_hist_append(&pkt, now_ms);
+		now_ms += TICK_MS;
+	}
+
+	sens_hist_stats_get(&st);
+	centi = st.bytes * 100 / st.samples;
+	TC_PRINT("history: %u samples in %u bytes, %u.%02u bytes per sample (packet %u)\n",
+		 st.samples, st.bytes, centi / 100, centi % 100,
+		 (unsigned int)sizeof(struct sens_packet));
+	zassert_true(centi <= 250, "%u.%02u bytes per sample", centi / 100, centi % 100);
+}
+
+ZTEST_SUITE(sens_hist, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,124 @@
+/**
+ * @file test_orient.c
+ * @author Wilfred Mallawa
+ * @brief CORDIC atan2 and vector magnitude at known points, over a
+ *        sweep of the accelerometer range, and the angles the
+ *        orientation engine takes from gravity on each axis.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdlib.h>
+#include <ztest.h>
+
+#include "sens_orient.h"
+
+struct atan2_point {
+	int32_t y, x;
+	int16_t want;       //centi-degrees
+};
+
+/* Exact or tabulated tangents, in every quadrant and on the axes */
+static const struct atan2_point points[] = {
+	{ 0, 1000, 0 },
+	{ 1000, 1000, 4500 },
+	{ 1000, 0, 9000 },
+	{ 1000, -1000, 13500 },
+	{ 0, -1000, 18000 },
+	{ -1000, -1000, -13500 },
+	{ -1000, 0, -9000 },
+	{ -1000, 1000, -4500 },
+	{ 1000, 1732, 3000 },       //tan 30 = 0.57735
+	{ 1732, 1000, 6000 },
+	{ 2679, 10000, 1500 },      //tan 15 = 0.26795
+	{ -1, 1000000, -0 },
+	{ 3, 4, 3687 },             //36.8699
+	{ 1 << 30, 1 << 30, 4500 }, //top of the input range
+};
+
+ZTEST(sens_orient, test_atan2_points)
+{
+	for (int i = 0; i < ARRAY_SIZE(points); i++) {
+		const struct atan2_point *p = &points[i];
+		int16_t got = sens_atan2(p->y, p->x);
+
+		zassert_within(got, p->want, 1, "atan2(%d, %d) = %d, want %d",
+			       p->y, p->x, got, p->want);
+	}
+}
+
+ZTEST(sens_orient, test_atan2_sweep)
+{
+	int16_t last = -18000;
+
+	/* Monotonic around the circle and odd in y */
+	for (int32_t y = -200; y <= 200; y++) {
+		int16_t a = sens_atan2(y, 100);
+
+		zassert_true(a >= last, "not monotonic at y %d", y);
+		zassert_equal(sens_atan2(-y, 100), -a, "not odd at y %d", y);
+		last = a;
+	}
+}
+
+ZTEST(sens_orient, test_vec_mag)
+{
+	zassert_equal(sens_vec_mag(0, 0), 0, "zero vector");
+	zassert_equal(sens_vec_mag(3, 4), 5, "3 4 5");
+	zassert_equal(sens_vec_mag(-5, 12), 13, "5 12 13");
+	zassert_equal(sens_vec_mag(0, -1000), 1000, "on an axis");
+
+	/* Within 1 + 0.01 % over +-2 g in milli-g */
+	for (int32_t a = -2000; a <= 2000; a += 37) {
+		for (int32_t b = -2000; b <= 2000; b += 41) {
+			int64_t sq = (int64_t)a * a + (int64_t)b * b;
+			int32_t got = sens_vec_mag(a, b);
+			int32_t tol = 1 + got / 10000;
+
+			zassert_true((int64_t)(got - tol) * (got - tol) <= sq &&
+				     (int64_t)(got + tol) * (got + tol) >= sq,
+				     "|(%d, %d)| = %d", a, b, got);
+		}
+	}
+}
+
+ZTEST(sens_orient, test_gravity)
+{
+	struct sens_orient o;
+
+	/* Flat, face up */
+	sens_orient_reset();
+	sens_orient_update(0, 0, 1000);
+	sens_orient_get(&o);
+	zassert_equal(o.samples, 1, "samples %u", o.samples);
+	zassert_within(o.pitch, 0, 1, "pitch %d", o.pitch);
+	zassert_within(o.roll, 0, 1, "roll %d", o.roll);
+	zassert_within(o.tilt, 0, 1, "tilt %d", o.tilt);
+	zassert_equal(o.xy, 0, "xy %d", o.xy);
+
+	/* On its side, y up */
+	sens_orient_reset();
+	sens_orient_update(0, 1000, 0);
+	sens_orient_get(&o);
+	zassert_within(o.roll, 9000, 1, "roll %d", o.roll);
+	zassert_within(o.tilt, 9000, 1, "tilt %d", o.tilt);
+	zassert_within(o.xy, 0, 1, "xy %d", o.xy);
+
+	/* Nose down, x up */
+	sens_orient_reset();
+	sens_orient_update(1000, 0, 0);
+	sens_orient_get(&o);
+	zassert_within(o.pitch, -9000, 1, "pitch %d", o.pitch);
+	zassert_within(o.xy, 9000, 1, "xy %d", o.xy);
+	/* Folded, y down reads as y up */
+	zassert_equal(sens_tilt_xy(-500, -1000), sens_tilt_xy(500, 1000), "y < 0 not folded");
+	zassert_equal(sens_tilt_xy(-1000, 0), -9000, "x down");
+
+	/* Upside down */
+	sens_orient_reset();
+	sens_orient_update(0, 0, -1000);
+	sens_orient_get(&o);
+	zassert_within(o.tilt, 18000, 1, "tilt %d", o.tilt);
+}
+
+ZTEST_SUITE(sens_orient, NULL, NULL, NULL, NULL, NULL);
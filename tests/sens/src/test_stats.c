@@ -0,0 +1,104 @@
+/**
+ * @file test_stats.c
+ * @author Wilfred Mallawa
+ * @brief sens_stats windows against a brute force recomputation over
+ *        the same samples, gaps included.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <ztest.h>
+
+#include "sens_stats.h"
+
+#define BUCKETS     CONFIG_APP_SENS_STATS_BUCKETS
+#define SAMPLES     1200
+#define BUCKET_MS   (60U * MSEC_PER_SEC / BUCKETS)     //1 min window
+
+static uint32_t t_ms[SAMPLES];
+static int16_t temp[SAMPLES];
+
+static uint32_t isqrt(uint64_t v)
+{
+	uint64_t r = 0;
+
+	while ((r + 1) * (r + 1) <= v) {
+		r++;
+	}
+	return r;
+}
+
+/* The 1 min window over samples 0..n, as sens_stats_get reports it */
+static void brute_1min(int n, struct sens_stat *want)
+{
+	uint32_t open = t_ms[n] / BUCKET_MS;
+	uint32_t oldest = (open >= BUCKETS - 1) ? open - (BUCKETS - 1) : 0;
+	int64_t sum = 0, sumsq = 0;
+	int32_t ref = temp[0];
+
+	*want = (struct sens_stat){ .min = INT32_MAX, .max = INT32_MIN };
+	for (int i = 0; i <= n; i++) {
+		int32_t v = temp[i] - ref;
+
+		if (t_ms[i] / BUCKET_MS < oldest) {
+			continue;
+		}
+		want->min = MIN(want->min, temp[i]);
+		want->max = MAX(want->max, temp[i]);
+		sum += v;
+		sumsq += (int64_t)v * v;
+		want->count++;
+	}
+	want->mean = ref + (int32_t)(sum / want->count);
+	want->stddev = isqrt(MAX(0, (sumsq - sum * sum / want->count) / want->count));
+}
+
+ZTEST(sens_stats, test_1min_brute_force)
+{
+	uint32_t rnd = 7;
+	uint32_t now = 0;
+	int16_t v = 2200;
+
+	for (int i = 0; i < SAMPLES; i++) {
+		struct sens_packet pkt = { .valid = SENS_VALID_HTS221 };
+		struct sens_stat got, want;
+
+		rnd = rnd * 1103515245 + 12345;
+		v += (int16_t)((rnd >> 16) % 41) - 20;
+		/* 1 s samples, one gap longer than the window */
+		now += (i == SAMPLES / 2) ? 150 * MSEC_PER_SEC : MSEC_PER_SEC;
+		t_ms[i] = now;
+		temp[i] = v;
+		pkt.hts221_temp = v;
+		sens_stats_update(&pkt, now);
+
+		zassert_equal(sens_stats_get(SENS_STAT_TEMP, SENS_STAT_1MIN, &got), 0,
+			      "get failed");
+		brute_1min(i, &want);
+		zassert_equal(got.count, want.count, "count at %d", i);
+		zassert_equal(got.min, want.min, "min at %d", i);
+		zassert_equal(got.max, want.max, "max at %d", i);
+		zassert_equal(got.mean, want.mean, "mean at %d", i);
+		zassert_within(got.stddev, want.stddev, 1, "stddev at %d", i);
+	}
+}
+
+ZTEST(sens_stats, test_invalid_skipped)
+{
+	struct sens_packet pkt = { .hts221_temp = 9999 };
+	struct sens_stat st;
+
+	/* Only the pressure channel sees this one */
+	pkt.valid = SENS_VALID_LPS22HB;
+	pkt.lps22hb_press = 100000;
+	sens_stats_update(&pkt, 10 * MSEC_PER_SEC * 3600);
+	zassert_equal(sens_stats_get(SENS_STAT_ECO2, SENS_STAT_24H, &st), 0, "get failed");
+	zassert_equal(st.count, 0, "eco2 counted without SENS_VALID_CCS811");
+	zassert_equal(sens_stats_get(SENS_STAT_PRESS, SENS_STAT_1MIN, &st), 0, "get failed");
+	zassert_equal(st.count, 1, "pressure not counted");
+	zassert_equal(st.mean, 100000, "pressure mean %d", st.mean);
+	zassert_equal(sens_stats_get(SENS_STAT_CHAN_COUNT, SENS_STAT_1MIN, &st), -EINVAL,
+		      "bad channel accepted");
+}
+
+ZTEST_SUITE(sens_stats, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,167 @@
+/**
+ * @file test_telem.c
+ * @author Wilfred Mallawa
+ * @brief COBS as the device encodes it and the host decoder undoes it,
+ *        frames the decoder has to reject, and packets framed by the
+ *        device and decoded from a byte stream shared with console text.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <string.h>
+#include <ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+#include "sens_telem_proto.h"
+#include "telem_hooks.h"
+
+#define BATCH       CONFIG_APP_SENS_TELEM_BATCH
+#define E2E_PKTS    (2 * BATCH + BATCH / 2)
+
+static uint8_t in[600];
+static uint8_t enc[sizeof(in) + sizeof(in) / 254 + 2];
+
+static void round_trip(size_t len)
+{
+	size_t n = telem_dev_cobs_encode(in, len, enc);
+
+	zassert_true(n <= len + len / 254 + 1, "%zu bytes encoded to %zu", len, n);
+	zassert_is_null(memchr(enc, 0, n), "zero in the encoding of %zu bytes", len);
+	zassert_equal(telem_host_cobs_decode(enc, n), len, "length of %zu bytes", len);
+	zassert_mem_equal(enc, in, len, "content of %zu bytes", len);
+}
+
+ZTEST(sens_telem, test_cobs_patterns)
+{
+	static const size_t lens[] = { 1, 2, 253, 254, 255, 508, 600 };
+
+	for (int i = 0; i < ARRAY_SIZE(lens); i++) {
+		/* all zeros */
+		memset(in, 0, lens[i]);
+		round_trip(lens[i]);
+		/* no zeros, runs across the 254 byte code limit */
+		memset(in, 0xa5, lens[i]);
+		round_trip(lens[i]);
+		/* zero at both ends */
+		in[0] = in[lens[i] - 1] = 0;
+		round_trip(lens[i]);
+	}
+}
+
+ZTEST(sens_telem, test_cobs_random)
+{
+	uint32_t rnd = 3;
+
+	for (int pass = 0; pass < 50; pass++) {
+		size_t len = 1 + pass * 11;
+
+		for (size_t i = 0; i < len; i++) {
+			rnd = rnd * 1103515245 + 12345;
+			/* about one zero in eight */
+			in[i] = ((rnd >> 16) & 7) ? (rnd >> 24) | 1 : 0;
+		}
+		round_trip(len);
+	}
+}
+
+ZTEST(sens_telem, test_rejected)
+{
+	uint8_t frame[sizeof(struct sens_telem_hdr) + sizeof(struct sens_telem_rec) + 2] = {
+		SENS_TELEM_VERSION, 1,
+	};
+	size_t n;
+
+	/* Bad CRC */
+	n = telem_dev_cobs_encode(frame, sizeof(frame), enc);
+	zassert_equal(telem_host_frame_decode(enc, n), -1, "bad crc accepted");
+
+	/* Count does not match the length */
+	frame[1] = 2;
+	n = telem_dev_cobs_encode(frame, sizeof(frame), enc);
+	zassert_equal(telem_host_frame_decode(enc, n), -1, "bad length accepted");
+
+	/* Not COBS, a code byte pointing past the end */
+	enc[0] = 0x40;
+	zassert_equal(telem_host_frame_decode(enc, 8), -1, "bad cobs accepted");
+}
+
+static struct sens_telem_rec got[E2E_PKTS];
+static int n_got;
+
+static void collect(const uint8_t *rec)
+{
+	if (n_got < ARRAY_SIZE(got)) {
+		memcpy(&got[n_got], rec, sizeof(got[0]));
+	}
+	n_got++;
+}
+
+ZTEST(sens_telem, test_end_to_end)
+{
+	static const char text[] = "[00:00:01.000,000] <inf> sens: console text\r\n";
+	static struct sens_packet sent[E2E_PKTS];
+	static uint8_t wire[SENS_TELEM_COBS_MAX + 2];
+	struct telem_host_counts before, after;
+	const uint32_t seq = 1000;
+	size_t len;
+	int n;
+
+	for (int i = 0; i < E2E_PKTS; i++) {
+		sent[i] = (struct sens_packet){
+			.lps22hb_press = 100000 + 7 * i,
+			.hts221_temp = -500 + 33 * i,
+			.hts221_rh = 4000 + i,
+			.lps22hb_temp = 2100 - i,
+			.xy_angle = -18000 + 900 * i,
+			.batt_mV = 4100 - i,
+			.ccs811_eco2 = 400 + 10 * i,
+			.ccs811_etvoc = i,
+			.batt_pptt = 9000 + i,
+			.batt_tte_min = 600 - i,
+			.valid = i & 0x1f,
+		};
+	}
+
+	telem_host_counts_get(&before);
+	n_got = 0;
+	for (int i = 0; i < E2E_PKTS; i += n) {
+		n = MIN(BATCH, E2E_PKTS - i);
+		len = telem_dev_frame(&sent[i], n, seq + i, 3, wire);
+		/* Console text between frames, and the frame split across reads */
+		telem_host_feed((const uint8_t *)text, sizeof(text) - 1, collect);
+		telem_host_feed(wire, len / 3, collect);
+		telem_host_feed(wire + len / 3, len - len / 3, collect);
+	}
+	/* A damaged frame is dropped whole */
+	len = telem_dev_frame(&sent[0], 1, seq + E2E_PKTS, 3, wire);
+	wire[len / 2] ^= 0x04;
+	telem_host_feed(wire, len, collect);
+	telem_host_counts_get(&after);
+
+	zassert_equal(n_got, E2E_PKTS, "decoded %d of %d", n_got, E2E_PKTS);
+	zassert_equal(after.frames - before.frames, DIV_ROUND_UP(E2E_PKTS, BATCH),
+		      "%lu frames", after.frames - before.frames);
+	zassert_true(after.rejected > before.rejected, "damaged frame accepted");
+	zassert_equal(after.seq_gaps, before.seq_gaps, "sequence gap");
+	zassert_equal(after.dropped, 3, "dropped %lu", after.dropped);
+
+	for (int i = 0; i < E2E_PKTS; i++) {
+		const struct sens_telem_rec *r = &got[i];
+		const struct sens_packet *p = &sent[i];
+
+		zassert_equal(sys_le32_to_cpu(r->seq), seq + i, "seq at %d", i);
+		zassert_equal(sys_le32_to_cpu(r->press), p->lps22hb_press, "press at %d", i);
+		zassert_equal((int16_t)sys_le16_to_cpu(r->temp), p->hts221_temp, "temp at %d", i);
+		zassert_equal(sys_le16_to_cpu(r->rh), p->hts221_rh, "rh at %d", i);
+		zassert_equal((int16_t)sys_le16_to_cpu(r->ptemp), p->lps22hb_temp, "ptemp at %d", i);
+		zassert_equal((int16_t)sys_le16_to_cpu(r->xy_angle), p->xy_angle, "angle at %d", i);
+		zassert_equal(sys_le16_to_cpu(r->batt_mV), p->batt_mV, "batt at %d", i);
+		zassert_equal(sys_le16_to_cpu(r->eco2), p->ccs811_eco2, "eco2 at %d", i);
+		zassert_equal(sys_le16_to_cpu(r->etvoc), p->ccs811_etvoc, "etvoc at %d", i);
+		zassert_equal(sys_le16_to_cpu(r->batt_pptt), p->batt_pptt, "pptt at %d", i);
+		zassert_equal(sys_le16_to_cpu(r->batt_tte_min), p->batt_tte_min, "tte at %d", i);
+		zassert_equal(r->valid, p->valid, "valid at %d", i);
+	}
+}
+
+ZTEST_SUITE(sens_telem, NULL, NULL, NULL, NULL, NULL);
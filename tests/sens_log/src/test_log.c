@@ -0,0 +1,231 @@
+/**
+ * @file test_log.c
+ * @author Wilfred Mallawa
+ * @brief sens_log on the flash simulator: record order across batches,
+ *        flushes racing full batches, walks that commit from their
+ *        callback or see the log wrap under them, and the write
+ *        amplification and erase rate of a wrapped partition. The
+ *        simulated flash keeps its content between runs, so each test
+ *        only counts its own records.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <ztest.h>
+#include <zephyr/storage/flash_map.h>
+
+#include "sens_log.h"
+
+#define BATCH         CONFIG_APP_SENS_LOG_BATCH
+#define PART_RECS     (FLASH_AREA_SIZE(sens_log) / sizeof(struct sens_log_rec))
+#define ERASE_CYCLES  10000         //nRF52 rated endurance
+
+static uint32_t now_ms = 1;
+
+struct log_count {
+	uint16_t boot;
+	uint32_t from_ms;
+	uint32_t n;
+	uint32_t last_ms;
+	bool ordered;
+	bool intact;
+};
+
+/* Packets carry their own timestamp, so a record shows where it came from */
+static void append_n(int n, bool paced)
+{
+	for (int i = 0; i < n; i++) {
+		struct sens_packet pkt = {
+			.hts221_temp = (int16_t)now_ms,
+			.batt_mV = 3900,
+		};
+
+		sens_log_append(&pkt, now_ms++);
+		/* Let the work queue commit each full batch */
+		if (paced && i % BATCH == BATCH - 1) {
+			k_msleep(1);
+		}
+	}
+}
+
+static int count_rec(const struct sens_log_rec *rec, uint16_t boot, void *arg)
+{
+	struct log_count *c = arg;
+
+	if (boot != c->boot || rec->t_ms < c->from_ms) {
+		return 0;
+	}
+	if (c->n > 0 && rec->t_ms <= c->last_ms) {
+		c->ordered = false;
+	}
+	if (rec->pkt.hts221_temp != (int16_t)rec->t_ms || rec->pkt.batt_mV != 3900) {
+		c->intact = false;
+	}
+	c->last_ms = rec->t_ms;
+	c->n++;
+	return 0;
+}
+
+static void count_init(struct log_count *c, uint32_t from_ms)
+{
+	struct sens_log_stats st;
+
+	sens_log_stats_get(&st);
+	*c = (struct log_count){
+		.boot = st.boot,
+		.from_ms = from_ms,
+		.ordered = true,
+		.intact = true,
+	};
+}
+
+static void count_from(struct log_count *c, uint32_t from_ms)
+{
+	count_init(c, from_ms);
+	zassert_equal(sens_log_walk(count_rec, c), 0, "walk failed");
+}
+
+ZTEST(sens_log, test_order)
+{
+	uint32_t from_ms = now_ms;
+	struct sens_log_stats before, after;
+	struct log_count c;
+
+	sens_log_stats_get(&before);
+	append_n(3 * BATCH + 5, true);
+	zassert_equal(sens_log_flush(), 0, "flush failed");
+	zassert_equal(sens_log_flush(), 0, "empty flush failed");
+	sens_log_stats_get(&after);
+
+	count_from(&c, from_ms);
+	zassert_equal(after.dropped, before.dropped, "dropped %u", after.dropped - before.dropped);
+	zassert_equal(c.n, 3 * BATCH + 5, "walked %u", c.n);
+	zassert_true(c.ordered, "out of order");
+	zassert_true(c.intact, "record damaged");
+	zassert_equal(c.last_ms, now_ms - 1, "ends at %u", c.last_ms);
+}
+
+/*
+ * Unpaced, the work queue may still hold the first batch when the second
+ * fills. Whatever the scheduling, every record is either committed once,
+ * in order, or counted as dropped.
+ */
+ZTEST(sens_log, test_busy_flush)
+{
+	uint32_t from_ms = now_ms;
+	struct sens_log_stats before, after;
+	struct log_count c;
+
+	sens_log_stats_get(&before);
+	append_n(2 * BATCH + 1, false);
+	zassert_equal(sens_log_flush(), 0, "flush failed");
+	append_n(BATCH, false);
+	zassert_equal(sens_log_flush(), 0, "flush failed");
+	sens_log_stats_get(&after);
+
+	count_from(&c, from_ms);
+	zassert_true(c.ordered, "out of order");
+	zassert_true(c.intact, "record damaged");
+	zassert_equal(c.n + after.dropped - before.dropped, 3 * BATCH + 1,
+		      "%u walked, %u dropped", c.n, after.dropped - before.dropped);
+}
+
+static int commit_from_walk(const struct sens_log_rec *rec, uint16_t boot, void *arg)
+{
+	int *rc = arg;
+
+	/* The commit takes the FCB lock, a walk holding it would deadlock */
+	if (*rc == 1) {
+		append_n(1, false);
+		*rc = sens_log_flush();
+	}
+	return 0;
+}
+
+ZTEST(sens_log, test_walk_unlocked)
+{
+	uint32_t from_ms;
+	struct log_count c;
+	int rc = 1;
+
+	append_n(BATCH, true);
+	from_ms = now_ms;
+	zassert_equal(sens_log_walk(commit_from_walk, &rc), 0, "walk failed");
+	zassert_equal(rc, 0, "flush in the walk failed: %d", rc);
+
+	count_from(&c, from_ms);
+	zassert_equal(c.n, 1, "record from the walk not committed");
+}
+
+static bool rotated;
+
+static int rotate_from_walk(const struct sens_log_rec *rec, uint16_t boot, void *arg)
+{
+	/* Overwrite the whole log under the walk, once */
+	if (!rotated) {
+		rotated = true;
+		append_n(PART_RECS, true);
+		zassert_equal(sens_log_flush(), 0, "flush failed");
+	}
+	return count_rec(rec, boot, arg);
+}
+
+ZTEST(sens_log, test_walk_rotated)
+{
+	struct sens_log_stats before, after;
+	struct log_count c;
+
+	append_n(BATCH, true);
+	sens_log_stats_get(&before);
+	count_init(&c, 0);
+	zassert_equal(sens_log_walk(rotate_from_walk, &c), 0, "walk failed");
+	sens_log_stats_get(&after);
+
+	/* The walk's sector was erased, it went on from the new oldest entry */
+	zassert_true(after.erases > before.erases, "log never rotated");
+	zassert_true(c.n > PART_RECS / 2, "walked %u of the new log", c.n);
+	zassert_true(c.ordered, "out of order");
+	zassert_true(c.intact, "record damaged");
+	zassert_equal(c.last_ms, now_ms - 1, "ends at %u", c.last_ms);
+}
+
+ZTEST(sens_log, test_wear)
+{
+	const uint32_t part = FLASH_AREA_SIZE(sens_log);
+	uint32_t from_ms = now_ms;
+	struct sens_log_stats before, st;
+	uint32_t samples, entries, amp, per_erase, days;
+	struct log_count c;
+
+	/* Fill the partition first, then measure a wrap in steady state */
+	append_n(PART_RECS, true);
+	zassert_equal(sens_log_flush(), 0, "flush failed");
+	sens_log_stats_get(&before);
+	append_n(PART_RECS, true);
+	zassert_equal(sens_log_flush(), 0, "flush failed");
+	sens_log_stats_get(&st);
+
+	samples = st.samples - before.samples;
+	entries = st.entries - before.entries;
+	amp = (st.flash_bytes - before.flash_bytes) * 100 / (st.payload_bytes - before.payload_bytes);
+	zassert_true(st.erases - before.erases >= part / st.sector_size,
+		     "%u erases", st.erases - before.erases);
+	per_erase = samples / (st.erases - before.erases);
+
+	/* Each sector is erased once per wrap, every per_erase * sectors records */
+	days = (uint32_t)((uint64_t)ERASE_CYCLES * per_erase * (part / st.sector_size) / 86400);
+	TC_PRINT("log: %u records in %u entries, %u.%02u write amplification, "
+		 "%u records per erase\n", samples, entries, amp / 100, amp % 100, per_erase);
+	TC_PRINT("log: %u erase cycles last %u days at 1 Hz, %u at one a minute\n",
+		 ERASE_CYCLES, days, days * 60);
+	zassert_true(amp <= 105, "write amplification %u.%02u", amp / 100, amp % 100);
+
+	/* The oldest sectors are gone, what is left is still in order */
+	count_from(&c, from_ms);
+	zassert_true(c.n < samples, "wrapped log holds %u of %u", c.n, samples);
+	zassert_true(c.ordered, "out of order");
+	zassert_true(c.intact, "record damaged");
+	zassert_equal(c.last_ms, now_ms - 1, "ends at %u", c.last_ms);
+}
+
+ZTEST_SUITE(sens_log, NULL, NULL, NULL, NULL, NULL);
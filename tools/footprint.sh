@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# Build each configuration below and print the flash and RAM use the
+# linker reports for it as a markdown table, for the README.
+#
+#   tools/footprint.sh > footprint.md
+#
+# Builds go to build_fp/<name>, with the full west output in <name>.log.
+
+out=build_fp
+mkdir -p "$out"
+
+printf '| configuration | overlay | flash | RAM |\n'
+printf '|---|---|---|---|\n'
+
+while read -r name overlay; do
+	log="$out/$name.log"
+
+	if ! west build -p always -d "$out/$name" -- \
+		${overlay:+"-DOVERLAY_CONFIG=$overlay"} > "$log" 2>&1; then
+		printf '| %s | %s | build failed, see %s | |\n' "$name" \
+			"${overlay:--}" "$log"
+		continue
+	fi
+	flash=$(awk '$1 == "FLASH:" { print $2 " " $3 }' "$log")
+	ram=$(awk '$1 == "SRAM:" { print $2 " " $3 }' "$log")
+	printf '| %s | %s | %s | %s |\n' "$name" "${overlay:--}" "$flash" "$ram"
+done <<CONFIGS
+default
+lowpower lowpower.conf
+smallram smallram.conf
+smallram+lowpower lowpower.conf;smallram.conf
+CONFIGS
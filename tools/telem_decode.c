@@ -0,0 +1,250 @@
+/**
+ * @file telem_decode.c
+ * @author Wilfred Mallawa
+ * @brief Host decoder for the binary telemetry stream (lib/sens/sens_telem.c).
+ *        Reads frames from a file, a serial port or PTY, or stdin, checks
+ *        them and prints one CSV row per record, in the columns of
+ *        'sens history' so the output can be replayed by the replay
+ *        backend. Bytes outside valid frames (console text on a shared
+ *        UART) are skipped. Frame counts go to stderr at the end.
+ *
+ *          cc -O2 -Wall -I lib/sens -o telem_decode tools/telem_decode.c
+ *          ./telem_decode /dev/pts/3 > trace.csv
+ *
+ *        tests/sens builds it with TELEM_DECODE_LIB, without main(), the
+ *        CSV output and the POSIX I/O, and feeds it device frames end to
+ *        end.
+ * @version 0.1
+ * @date 2022-06-23
+ *
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef TELEM_DECODE_LIB
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#include "sens_telem_proto.h"
+
+struct decode_stats {
+    unsigned long frames;
+    unsigned long records;
+    unsigned long bad_cobs;
+    unsigned long bad_crc;
+    unsigned long bad_len;
+    unsigned long seq_gaps;         //packets missing between records
+    unsigned long dropped;          //as reported by the device
+};
+
+static struct decode_stats st;
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+/* Zephyr's crc16_ccitt() */
+static uint16_t crc16_ccitt(uint16_t seed, const uint8_t *src, size_t len)
+{
+    for (; len > 0; len--) {
+        uint8_t e = seed ^ *src++;
+        uint8_t f = e ^ (e << 4);
+
+        seed = (seed >> 8) ^ ((uint16_t)f << 8) ^ ((uint16_t)f << 3) ^
+               ((uint16_t)f >> 4);
+    }
+    return seed;
+}
+
+/* Undo COBS in place, returns the decoded length or -1 if malformed */
+static int cobs_decode(uint8_t *buf, size_t len)
+{
+    size_t i = 0, o = 0;
+
+    while (i < len) {
+        uint8_t code = buf[i++];
+
+        if (code == 0 || i + code - 1 > len) {
+            return -1;
+        }
+        for (int n = 1; n < code; n++) {
+            buf[o++] = buf[i++];
+        }
+        if (code != 0xff && i < len) {
+            buf[o++] = 0;
+        }
+    }
+    return o;
+}
+
+/* Called with each record of a good frame, still little endian */
+typedef void (*rec_fn)(const uint8_t *rec);
+
+/* Bytes since the last delimiter */
+struct stream {
+    uint8_t buf[SENS_TELEM_COBS_MAX];
+    size_t len;
+    bool overlong;
+};
+
+/* One delimited frame, still COBS encoded */
+static void frame_decode(uint8_t *buf, size_t len, rec_fn on_rec)
+{
+    static uint32_t last_seq;
+    const size_t hdr_len = sizeof(struct sens_telem_hdr);
+    const size_t rec_len = sizeof(struct sens_telem_rec);
+    int n = cobs_decode(buf, len);
+    unsigned int count;
+
+    if (n < 0) {
+        st.bad_cobs++;
+        return;
+    }
+    if ((size_t)n < hdr_len + 2 || buf[0] != SENS_TELEM_VERSION) {
+        st.bad_len++;
+        return;
+    }
+    count = buf[offsetof(struct sens_telem_hdr, count)];
+    if (count == 0 || count > SENS_TELEM_BATCH_MAX ||
+        (size_t)n != hdr_len + count * rec_len + 2) {
+        st.bad_len++;
+        return;
+    }
+    if (crc16_ccitt(SENS_TELEM_CRC_SEED, buf, n - 2) != get_le16(buf + n - 2)) {
+        st.bad_crc++;
+        return;
+    }
+    st.frames++;
+    st.dropped = get_le32(buf + offsetof(struct sens_telem_hdr, dropped));
+
+    for (unsigned int i = 0; i < count; i++) {
+        const uint8_t *r = buf + hdr_len + i * rec_len;
+        uint32_t seq = get_le32(r + offsetof(struct sens_telem_rec, seq));
+
+        if (last_seq != 0 && seq > last_seq + 1) {
+            st.seq_gaps += seq - last_seq - 1;
+        }
+        last_seq = seq;
+        on_rec(r);
+        st.records++;
+    }
+}
+
+/* Split raw input on the zero delimiters, anything too long was not one of ours */
+static void stream_feed(struct stream *s, const uint8_t *in, size_t n, rec_fn on_rec)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (in[i] != 0) {
+            if (s->len < sizeof(s->buf)) {
+                s->buf[s->len++] = in[i];
+            } else {
+                s->overlong = true;
+            }
+            continue;
+        }
+        if (s->overlong) {
+            st.bad_len++;
+        } else if (s->len > 0) {
+            frame_decode(s->buf, s->len, on_rec);
+        }
+        s->len = 0;
+        s->overlong = false;
+    }
+}
+
+#ifndef TELEM_DECODE_LIB
+/* Centi-units as the device's SENS_CENTI_ARGS prints them */
+static void print_centi(int32_t v, char sep)
+{
+    printf("%s%d.%02d%c", v < 0 ? "-" : "", (v < 0 ? -v : v) / 100,
+           (v < 0 ? -v : v) % 100, sep);
+}
+
+static void print_rec(const uint8_t *r)
+{
+    const size_t o_temp = offsetof(struct sens_telem_rec, temp);
+    uint16_t pptt = get_le16(r + offsetof(struct sens_telem_rec, batt_pptt));
+
+    printf("%u,", get_le32(r + offsetof(struct sens_telem_rec, time_ms)));
+    print_centi((int16_t)get_le16(r + o_temp), ',');
+    print_centi(get_le16(r + offsetof(struct sens_telem_rec, rh)), ',');
+    printf("%u,", get_le32(r + offsetof(struct sens_telem_rec, press)));
+    print_centi((int16_t)get_le16(r + offsetof(struct sens_telem_rec, ptemp)), ',');
+    print_centi((int16_t)get_le16(r + offsetof(struct sens_telem_rec, xy_angle)), ',');
+    printf("%u,%u,%u,%u.%02u,%u,%u,0x%02x\n",
+           get_le16(r + offsetof(struct sens_telem_rec, eco2)),
+           get_le16(r + offsetof(struct sens_telem_rec, etvoc)),
+           get_le16(r + offsetof(struct sens_telem_rec, batt_mV)),
+           pptt / 100, pptt % 100,
+           get_le16(r + offsetof(struct sens_telem_rec, batt_tte_min)),
+           get_le32(r + offsetof(struct sens_telem_rec, seq)),
+           r[offsetof(struct sens_telem_rec, valid)]);
+}
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+int main(int argc, char **argv)
+{
+    static struct stream s;
+    uint8_t in[256];
+    int fd = STDIN_FILENO;
+    struct sigaction sa = { .sa_handler = on_signal };
+    ssize_t got;
+
+    if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+        fprintf(stderr, "usage: %s [file|tty]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2) {
+        fd = open(argv[1], O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+            return 1;
+        }
+    }
+    /* No line discipline, frames are binary */
+    if (isatty(fd)) {
+        struct termios tio;
+
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+    /* No SA_RESTART, a signal ends the blocking read */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("t_ms,temp_c,rh,press_pa,temp2_c,angle_deg,eco2_ppm,etvoc_ppb,"
+           "batt_mv,batt_pct,tte_min,seq,valid\n");
+
+    while (!stop && (got = read(fd, in, sizeof(in))) > 0) {
+        stream_feed(&s, in, got, print_rec);
+        fflush(stdout);
+    }
+
+    fprintf(stderr, "frames %lu, records %lu, device dropped %lu, seq gaps %lu, "
+            "bad crc %lu, bad cobs %lu, bad length %lu\n", st.frames,
+            st.records, st.dropped, st.seq_gaps, st.bad_crc, st.bad_cobs,
+            st.bad_len);
+    return 0;
+}
+#endif /* TELEM_DECODE_LIB */